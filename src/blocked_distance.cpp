@@ -0,0 +1,147 @@
+#include "blocked_distance.h"
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cfloat>
+
+#ifdef ICA_USE_CBLAS
+#include <cblas.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+static const int QUERY_TILE = 64;
+static const int REFERENCE_TILE = 128;
+
+// dots[i * REFERENCE_TILE + j] = a_i . b_j for an m x dim and an n x dim block
+static void tile_dot_products(const double* a, int m, const double* b, int n, int dim, double* dots)
+{
+#ifdef ICA_USE_CBLAS
+    cblas_dgemm(CblasRowMajor, CblasNoTrans, CblasTrans, m, n, dim,
+        1.0, a, dim, b, dim, 0.0, dots, REFERENCE_TILE);
+#else
+    for (int i = 0; i < m; ++i)
+    {
+        const double* x = a + static_cast<size_t>(i) * dim;
+        for (int j = 0; j < n; ++j)
+        {
+            const double* y = b + static_cast<size_t>(j) * dim;
+            double sum = 0;
+#ifdef _OPENMP
+            #pragma omp simd reduction(+:sum)
+#endif
+            for (int d = 0; d < dim; ++d)
+                sum += x[d] * y[d];
+            dots[static_cast<size_t>(i) * REFERENCE_TILE + j] = sum;
+        }
+    }
+#endif
+}
+
+void blocked_nearest(const double* queries, int query_stride, const int* query_rows, int query_count,
+    const double* references, int reference_count, int dim, int* nearest,
+    double (*squared_distance)(const double* a, const double* b, int dim))
+{
+    std::vector<double> reference_norms(reference_count);
+    double max_reference_norm = 0;
+    for (int j = 0; j < reference_count; ++j)
+    {
+        const double* y = references + static_cast<size_t>(j) * dim;
+        double sum = 0;
+        for (int d = 0; d < dim; ++d)
+            sum += y[d] * y[d];
+        reference_norms[j] = sum;
+        max_reference_norm = std::max(max_reference_norm, sum);
+    }
+
+    // Rounding error of one expanded distance is below (dim + 2) eps (||q||^2 + ||r||^2),
+    // two of them can swap order when they are within twice that
+    double error_scale = 4.0 * (dim + 2) * DBL_EPSILON;
+
+    int tiles = (query_count + QUERY_TILE - 1) / QUERY_TILE;
+
+    // Threads of their own only when called serially, inside a PICA_MS team
+    // the calling thread works through the tiles alone
+#ifdef _OPENMP
+    #pragma omp parallel if(!omp_in_parallel())
+#endif
+    {
+        std::vector<double> packed(static_cast<size_t>(QUERY_TILE) * dim);
+        std::vector<double> dots(static_cast<size_t>(QUERY_TILE) * REFERENCE_TILE);
+        std::vector<double> query_norms(QUERY_TILE);
+        std::vector<double> best_dist(QUERY_TILE);
+        std::vector<double> margin(QUERY_TILE);
+        // (expanded distance, reference) pairs that may still be the nearest
+        std::vector<std::vector<std::pair<double, int>>> candidates(QUERY_TILE);
+
+#ifdef _OPENMP
+        #pragma omp for schedule(dynamic)
+#endif
+        for (int t = 0; t < tiles; ++t)
+        {
+            int first = t * QUERY_TILE;
+            int m = std::min(QUERY_TILE, query_count - first);
+
+            // Pack the query tile so it is contiguous for the dot products
+            for (int i = 0; i < m; ++i)
+            {
+                const double* x = queries + static_cast<size_t>(query_rows[first + i]) * query_stride;
+                double* p = packed.data() + static_cast<size_t>(i) * dim;
+                double sum = 0;
+                for (int d = 0; d < dim; ++d)
+                {
+                    p[d] = x[d];
+                    sum += x[d] * x[d];
+                }
+                query_norms[i] = sum;
+                best_dist[i] = std::numeric_limits<double>::infinity();
+                margin[i] = error_scale * (sum + max_reference_norm);
+                candidates[i].clear();
+                nearest[first + i] = -1;
+            }
+
+            for (int r = 0; r < reference_count; r += REFERENCE_TILE)
+            {
+                int n = std::min(REFERENCE_TILE, reference_count - r);
+                tile_dot_products(packed.data(), m, references + static_cast<size_t>(r) * dim, n, dim, dots.data());
+
+                for (int i = 0; i < m; ++i)
+                {
+                    const double* row = dots.data() + static_cast<size_t>(i) * REFERENCE_TILE;
+                    for (int j = 0; j < n; ++j)
+                    {
+                        double d = query_norms[i] + reference_norms[r + j] - 2.0 * row[j];
+                        if (d <= best_dist[i] + margin[i])
+                        {
+                            candidates[i].emplace_back(d, r + j);
+                            best_dist[i] = std::min(best_dist[i], d);
+                        }
+                    }
+                }
+            }
+
+            // The expansion cancels badly once colonies sit on their emperors,
+            // so the near ties are decided by the exact distance
+            for (int i = 0; i < m; ++i)
+            {
+                const double* x = packed.data() + static_cast<size_t>(i) * dim;
+                // Candidates come in reference order, so ties keep the lower index
+                double best_exact = std::numeric_limits<double>::infinity();
+                for (const auto& candidate : candidates[i])
+                {
+                    if (candidate.first > best_dist[i] + margin[i])
+                        continue;
+                    int j = candidate.second;
+                    double exact = squared_distance(x, references + static_cast<size_t>(j) * dim, dim);
+                    if (exact < best_exact)
+                    {
+                        best_exact = exact;
+                        nearest[first + i] = j;
+                    }
+                }
+            }
+        }
+    }
+}
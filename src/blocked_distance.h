@@ -0,0 +1,18 @@
+#ifndef BLOCKED_DISTANCE_H
+#define BLOCKED_DISTANCE_H
+
+// Nearest reference for every query by the expansion ||q||^2 + ||r||^2 - 2 q.r.
+// Queries are rows query_rows[i] of a matrix with row pitch query_stride,
+// references are packed dim-wide. The work is tiled so that a block of queries
+// and a block of references stay in cache, query tiles are spread over OpenMP
+// threads unless the caller is already in a parallel region, and the dot
+// products go through cblas_dgemm when the engine is built with
+// ICA_USE_CBLAS. References whose expanded distance is within rounding error
+// of the best are rescored with squared_distance, so the answer matches an
+// exact search even when the expansion cancels. Ties go to the lower
+// reference index.
+void blocked_nearest(const double* queries, int query_stride, const int* query_rows, int query_count,
+    const double* references, int reference_count, int dim, int* nearest,
+    double (*squared_distance)(const double* a, const double* b, int dim));
+
+#endif
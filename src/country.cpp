@@ -1,45 +1,117 @@
 #include "Country.h"
 
+Emperor_Link::Emperor_Link(Population_Store* store, int slot)
+    : store(store), slot(slot)
+{}
+
+Emperor_Link::operator Country*() const
+{
+    return store->emperor_of(slot);
+}
+
+Country* Emperor_Link::operator->() const
+{
+    return store->emperor_of(slot);
+}
+
+Emperor_Link& Emperor_Link::operator=(Country* emperor)
+{
+    int old_id = store->empire_id[slot];
+    if (old_id >= 0 && store->emperor_slot[old_id] == slot)
+        store->emperor_slot[old_id] = -1;
+
+    store->empire_id[slot] = emperor ? store->empire_id[emperor->slot] : -1;
+    return *this;
+}
+
 // Constructor
-Country::Country(const std::vector<double>& loc)
-    : location(loc),
-    fitness(-std::numeric_limits<double>::infinity()),
-    vassal_of_empire(nullptr),
-    index_in_list(-1),
-    norm_imperialist_power(0)
+Country::Country(Population_Store& store, int slot, std::pmr::memory_resource* resource)
+    : store(&store),
+    slot(slot),
+    location(store.row(slot), store.dim),
+    fitness(store.fitness[slot]),
+    vassal_of_empire(&store, slot),
+    index_in_list(store.vassal_index[slot]),
+    norm_imperialist_power(0),
+    vassals(resource),
+    vassal_fitness_sum(0),
+    weakest_vassals(resource)
 {
+    store.countries[slot] = this;
 }
 
 // Evaluate fitness
 void Country::evaluate_fitness(const std::function<double(const std::vector<double>&)>& objective_function) 
 {
-    fitness = objective_function(location);
+    set_fitness(objective_function(location));
+}
+
+// Set fitness
+void Country::set_fitness(double value)
+{
+    double old_fitness = fitness;
+    fitness = value;
+    store->dirty[slot] = 0;
+    if (Country* emperor = vassal_of_empire)
+        emperor->vassal_fitness_changed(this, old_fitness);
 }
 
 // Remove and return the weakest vassal
 Country* Country::weakest_vassal_removal() 
 {
-    if (vassals.empty()) 
+    int index = weakest_vassals.weakest();
+    if (index < 0) 
         return nullptr;
 
-    Country* weakest = vassals[0];
-    size_t index = 0;
-
-    for (size_t i = 1; i < vassals.size(); ++i) {
-        if (vassals[i]->fitness < weakest->fitness) {
-            weakest = vassals[i];
-            index = i;
-        }
-    }
-
-    vassals.erase(vassals.begin() + index);
+    Country* weakest = vassals[index];
+    remove_vassal(weakest);
     return weakest;
 }
 
 // Add a vassal
 void Country::add_vassal(Country* vassal) 
 {
+    vassal->index_in_list = static_cast<int>(vassals.size());
     vassals.push_back(vassal);
+    vassal_fitness_sum += vassal->fitness;
+    weakest_vassals.update(vassal->index_in_list, vassals);
+}
+
+// Remove a vassal by swapping the last one into its place
+void Country::remove_vassal(Country* vassal)
+{
+    int idx = vassal->index_in_list;
+    if (idx < 0 || idx >= static_cast<int>(vassals.size()) || vassals[idx] != vassal)
+        return;
+
+    Country* last = vassals.back();
+    vassals[idx] = last;
+    last->index_in_list = idx;
+    vassals.pop_back();
+    vassal->index_in_list = -1;
+
+    vassal_fitness_sum -= vassal->fitness;
+    weakest_vassals.update(idx, vassals);
+    weakest_vassals.update(static_cast<int>(vassals.size()), vassals);
+}
+
+void Country::refresh_aggregates()
+{
+    vassal_fitness_sum = 0;
+    for (auto* vassal : vassals)
+        vassal_fitness_sum += vassal->fitness;
+    weakest_vassals.rebuild(vassals);
+}
+
+void Country::vassal_fitness_changed(Country* vassal, double old_fitness)
+{
+    // Not in this list, an update at -1 would land on an inner node of the tree
+    int idx = vassal->index_in_list;
+    if (idx < 0 || idx >= static_cast<int>(vassals.size()) || vassals[idx] != vassal)
+        return;
+
+    vassal_fitness_sum += vassal->fitness - old_fitness;
+    weakest_vassals.update(idx, vassals);
 }
 
 // Set emperor
@@ -50,8 +122,31 @@ void Country::add_emperor(Country* emperor)
 
 void Country::coup(Country* nearest_imperialist)
 {
-    this->vassals = nearest_imperialist->vassals;
-    this->add_vassal(nearest_imperialist);
+    // Take over the empire, its vassals now answer to this country
+    int id = store->empire_id[nearest_imperialist->slot];
+    store->emperor_slot[id] = slot;
+    store->empire_id[slot] = id;
+
+    // Ownership of the vassal list and its aggregates moves over without copying
+    vassals.clear();
+    vassals.swap(nearest_imperialist->vassals);
+    weakest_vassals.swap(nearest_imperialist->weakest_vassals);
+    vassal_fitness_sum = nearest_imperialist->vassal_fitness_sum;
+    nearest_imperialist->refresh_aggregates();
+
+    // The old emperor takes this country's place in the list, if it had one
+    int idx = index_in_list;
+    index_in_list = -1;
+    if (idx >= 0 && idx < static_cast<int>(vassals.size()) && vassals[idx] == this)
+    {
+        vassals[idx] = nearest_imperialist;
+        nearest_imperialist->index_in_list = idx;
+        vassal_fitness_sum += nearest_imperialist->fitness - fitness;
+        weakest_vassals.update(idx, vassals);
+    }
+    else
+    {
+        this->add_vassal(nearest_imperialist);
+    }
     nearest_imperialist->add_emperor(this);
-    this->vassal_of_empire = nullptr;
 }
@@ -1,38 +1,83 @@
 #ifndef COUNTRY_H
 #define COUNTRY_H
 
+#include "population_store.h"
+#include "tournament_tree.h"
 #include <vector>
+#include <memory_resource>
 #include <functional>
 #include <limits>
 
+class Country;
+
+// Resolves the emperor of a country through the empire id of its slot,
+// so vassals follow their empire when the emperor changes
+class Emperor_Link
+{
+    Population_Store* store;
+    int slot;
+
+public:
+    Emperor_Link(Population_Store* store, int slot);
+
+    operator Country*() const;
+    Country* operator->() const;
+
+    // Join the empire of emperor, nullptr detaches the country
+    Emperor_Link& operator=(Country* emperor);
+};
+
 class Country {
 public:
-    std::vector<double> location;
-    double fitness;
-    Country* vassal_of_empire;
-    int index_in_list;
+    Population_Store* store;
+    int slot;
+
+    Location_View location;
+    double& fitness;
+    Emperor_Link vassal_of_empire;
+    int& index_in_list;            // position in the emperor's vassals, -1 when not a vassal
     double norm_imperialist_power;
-    std::vector<Country*> vassals;
+    std::pmr::vector<Country*> vassals;
+
+    // Kept up to date as vassals join, leave or change fitness
+    double vassal_fitness_sum;
+    Tournament_Tree weakest_vassals;
 
-    // Constructor
-    Country(const std::vector<double>& loc);
+    // Constructor, binds the country to a slot of the store, the vassal
+    // containers allocate from resource
+    Country(Population_Store& store, int slot, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    Country(const Country&) = delete;
+    Country& operator=(const Country&) = delete;
 
     // Destructor
-    ~Country() = default;
+    virtual ~Country() = default;
 
     // Evaluate fitness using a provided objective function
     void evaluate_fitness(const std::function<double(const std::vector<double>&)>& objective_function);
 
+    // Set a known fitness without evaluating
+    void set_fitness(double value);
+
     // Remove and return the weakest vassal
     Country* weakest_vassal_removal();
 
     // Add a vassal
     virtual void add_vassal(Country* vassal);
 
+    // Remove a vassal in constant time, the last vassal takes its place
+    void remove_vassal(Country* vassal);
+
+    // Recompute the vassal aggregates from scratch
+    void refresh_aggregates();
+
+    // A vassal's fitness changed from old_fitness, ignored for countries not in the list
+    void vassal_fitness_changed(Country* vassal, double old_fitness);
+
     // Set emperor
     virtual void add_emperor(Country* emperor);
 
     virtual void coup(Country* nearest_imperialist);
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,13 @@
+#include "country_arena.h"
+
+Country_Arena::Country_Arena()
+    : pool(&arena), block(nullptr), object_size(0), capacity(0)
+{}
+
+void Country_Arena::reserve(int count, size_t size, size_t alignment)
+{
+    // A second reserve gets a fresh block, the old one goes with the arena
+    object_size = (size + alignment - 1) / alignment * alignment;
+    capacity = count;
+    block = static_cast<char*>(arena.allocate(object_size * (count > 0 ? count : 1), alignment));
+}
@@ -0,0 +1,37 @@
+#ifndef COUNTRY_ARENA_H
+#define COUNTRY_ARENA_H
+
+#include <memory_resource>
+#include <cstddef>
+
+// Bulk storage for the countries of one engine. The country objects share one
+// block carved from a monotonic arena, one object per slot, so threads can
+// construct them without locking. Vassal lists and tournament trees draw from
+// a synchronized pool on top of the same arena, so empires can be updated
+// from several threads. Nothing is freed one by one: the engine runs
+// the destructors and the arena releases every block at once.
+class Country_Arena
+{
+    std::pmr::monotonic_buffer_resource arena;
+    std::pmr::synchronized_pool_resource pool;
+    char* block;
+    size_t object_size;
+    int capacity;
+
+public:
+    Country_Arena();
+    Country_Arena(const Country_Arena&) = delete;
+    Country_Arena& operator=(const Country_Arena&) = delete;
+
+    // Room for count objects of up to size bytes, called once before the countries are created
+    void reserve(int count, size_t size, size_t alignment);
+
+    // Storage for the country in slot
+    void* storage(int slot) { return block + static_cast<size_t>(slot) * object_size; }
+
+    // Resource for the containers owned by the countries. Safe to share between
+    // threads, the pool serializes its refills from the arena.
+    std::pmr::memory_resource* resource() { return &pool; }
+};
+
+#endif
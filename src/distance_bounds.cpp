@@ -0,0 +1,132 @@
+#include "distance_bounds.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+Distance_Bounds::Distance_Bounds()
+    : dim(0), kernels(nullptr), max_drift(0), max_drift_at_pass(0),
+    distance_computations(0), distance_computations_skipped(0)
+{}
+
+double Distance_Bounds::distance(const double* a, const double* b) const
+{
+    return std::sqrt(kernels->squared_distance(a, b, dim));
+}
+
+void Distance_Bounds::reset()
+{
+    std::fill(assigned.begin(), assigned.end(), -1);
+    tracked.clear();
+}
+
+void Distance_Bounds::begin_pass(const std::vector<Country*>& empires, const Population_Store& store, const Phase_Kernels* kernels)
+{
+    this->kernels = kernels;
+    dim = store.dim;
+
+    size_t n = static_cast<size_t>(store.size);
+    if (assigned.size() != n)
+    {
+        assigned.assign(n, -1);
+        upper.resize(n);
+        lower.resize(n);
+        anchors.resize(n * dim);
+        drift_at_update.resize(n);
+        max_drift_at_update.resize(n);
+    }
+
+    // Positions shift when an empire falls, every bound refers to the old ones
+    int empire_count = static_cast<int>(empires.size());
+    if (tracked.size() != empires.size())
+    {
+        reset();
+        tracked = empires;
+        emperor_anchors.resize(static_cast<size_t>(empire_count) * dim);
+        for (int k = 0; k < empire_count; ++k)
+            std::copy(empires[k]->location.begin(), empires[k]->location.end(), emperor_anchors.begin() + static_cast<size_t>(k) * dim);
+        drift.assign(empire_count, 0);
+        max_drift = 0;
+    }
+    else
+    {
+        for (int k = 0; k < empire_count; ++k)
+            if (tracked[k] != empires[k])
+                replace(k, empires[k]);
+    }
+
+    drift_at_pass = drift;
+    max_drift_at_pass = max_drift;
+
+    half_gap.assign(empire_count, std::numeric_limits<double>::infinity());
+    for (int k = 0; k < empire_count; ++k)
+    {
+        for (int j = k + 1; j < empire_count; ++j)
+        {
+            double gap = 0.5 * distance(&emperor_anchors[static_cast<size_t>(k) * dim], &emperor_anchors[static_cast<size_t>(j) * dim]);
+            half_gap[k] = std::min(half_gap[k], gap);
+            half_gap[j] = std::min(half_gap[j], gap);
+        }
+    }
+    distance_computations += static_cast<long long>(empire_count) * (empire_count - 1) / 2;
+}
+
+void Distance_Bounds::record(int slot, const double* location, int nearest_idx, double upper_bound, double lower_bound)
+{
+    assigned[slot] = nearest_idx;
+    upper[slot] = upper_bound;
+    lower[slot] = lower_bound;
+    std::copy(location, location + dim, anchors.begin() + static_cast<size_t>(slot) * dim);
+    drift_at_update[slot] = drift[nearest_idx];
+    max_drift_at_update[slot] = max_drift;
+}
+
+int Distance_Bounds::nearest(int slot, const double* location, const Empire_Index& index, const std::vector<Country*>& empires)
+{
+    int empire_count = static_cast<int>(empires.size());
+    int a = assigned[slot];
+
+    if (a >= 0 && a < empire_count)
+    {
+        double moved = distance(location, &anchors[static_cast<size_t>(slot) * dim]);
+        double u = upper[slot] + moved + (drift[a] - drift_at_update[slot]);
+        double l = lower[slot] - moved - (max_drift - max_drift_at_update[slot]);
+        double s = half_gap[a] - 0.5 * ((drift[a] - drift_at_pass[a]) + (max_drift - max_drift_at_pass));
+        double bound = std::max(l, s);
+        distance_computations += 1;
+
+        if (u < bound)
+        {
+            distance_computations_skipped += empire_count - 1;
+            record(slot, location, a, u, l);
+            return a;
+        }
+
+        // Tighten the upper bound before giving up
+        u = distance(location, empires[a]->location.data());
+        distance_computations += 1;
+        if (u < bound)
+        {
+            distance_computations_skipped += empire_count - 2;
+            record(slot, location, a, u, l);
+            return a;
+        }
+    }
+
+    double nearest_dist, second_dist;
+    int best = index.nearest_two(location, nearest_dist, second_dist);
+    distance_computations += empire_count;
+    record(slot, location, best, std::sqrt(nearest_dist), std::sqrt(second_dist));
+    return best;
+}
+
+void Distance_Bounds::replace(int idx, Country* emperor)
+{
+    double* anchor = &emperor_anchors[static_cast<size_t>(idx) * dim];
+    double moved = distance(anchor, emperor->location.data());
+    std::copy(emperor->location.begin(), emperor->location.end(), anchor);
+
+    tracked[idx] = emperor;
+    drift[idx] += moved;
+    max_drift += moved;
+    distance_computations += 1;
+}
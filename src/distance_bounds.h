@@ -0,0 +1,59 @@
+#ifndef DISTANCE_BOUNDS_H
+#define DISTANCE_BOUNDS_H
+
+#include "country.h"
+#include "empire_index.h"
+#include "kernels.h"
+#include <vector>
+
+// Hamerly-style bound tracking for the nearest-emperor search in mutiny.
+// Every slot keeps an upper bound on the distance to its nearest emperor
+// position and a lower bound on the distance to any other one. Bounds are
+// loosened by how far the colony and the emperors have moved since they were
+// set, and a colony whose upper bound stays below the lower bound, or below
+// half the gap between its emperor and the next one, skips the search.
+class Distance_Bounds
+{
+    int dim;
+    const Phase_Kernels* kernels;
+
+    // Per slot
+    std::vector<int> assigned;
+    std::vector<double> upper;
+    std::vector<double> lower;
+    std::vector<double> anchors;
+    std::vector<double> drift_at_update;
+    std::vector<double> max_drift_at_update;
+
+    // Per empire position, drift is accumulated over every emperor move
+    std::vector<Country*> tracked;
+    std::vector<double> emperor_anchors;
+    std::vector<double> drift;
+    std::vector<double> drift_at_pass;
+    std::vector<double> half_gap;
+    double max_drift;
+    double max_drift_at_pass;
+
+    double distance(const double* a, const double* b) const;
+    void record(int slot, const double* location, int nearest_idx, double upper_bound, double lower_bound);
+
+public:
+    long long distance_computations;
+    long long distance_computations_skipped;
+
+    Distance_Bounds();
+
+    // Forget every bound, the next pass searches all colonies
+    void reset();
+
+    // Sync with the empires before a mutiny pass
+    void begin_pass(const std::vector<Country*>& empires, const Population_Store& store, const Phase_Kernels* kernels);
+
+    // Position in empires of the emperor nearest to the country in slot
+    int nearest(int slot, const double* location, const Empire_Index& index, const std::vector<Country*>& empires);
+
+    // The emperor at position idx was replaced by emperor during the pass
+    void replace(int idx, Country* emperor);
+};
+
+#endif
@@ -0,0 +1,192 @@
+#include "empire_index.h"
+#include "blocked_distance.h"
+#include <algorithm>
+#include <numeric>
+#include <limits>
+
+Empire_Index::Empire_Index()
+    : dim(0), kernels(nullptr), use_tree(false)
+{}
+
+void Empire_Index::build(const std::vector<Country*>& empires, int dim, const Phase_Kernels* kernels)
+{
+    this->dim = dim;
+    this->kernels = kernels;
+    int n = static_cast<int>(empires.size());
+    use_tree = (dim <= KD_TREE_MAX_DIM);
+
+    emperors = empires;
+    points.resize(static_cast<size_t>(n) * dim);
+    for (int i = 0; i < n; ++i)
+        std::copy(empires[i]->location.begin(), empires[i]->location.end(), points.begin() + static_cast<size_t>(i) * dim);
+
+    replaced.assign(n, 0);
+    moved.clear();
+
+    if (use_tree)
+    {
+        std::vector<int> order(n);
+        std::iota(order.begin(), order.end(), 0);
+        tree.resize(n);
+        build_tree(0, n, order);
+    }
+}
+
+void Empire_Index::build_tree(int lo, int hi, std::vector<int>& order)
+{
+    if (lo >= hi)
+        return;
+
+    // Split on the coordinate with the largest spread
+    int split_dim = 0;
+    double widest = -1;
+    for (int d = 0; d < dim; ++d)
+    {
+        double low = std::numeric_limits<double>::infinity();
+        double high = -low;
+        for (int i = lo; i < hi; ++i)
+        {
+            double v = points[static_cast<size_t>(order[i]) * dim + d];
+            low = std::min(low, v);
+            high = std::max(high, v);
+        }
+        if (high - low > widest)
+        {
+            widest = high - low;
+            split_dim = d;
+        }
+    }
+
+    int mid = (lo + hi) / 2;
+    std::nth_element(order.begin() + lo, order.begin() + mid, order.begin() + hi, [&](int a, int b)
+        {
+            return points[static_cast<size_t>(a) * dim + split_dim] < points[static_cast<size_t>(b) * dim + split_dim];
+        });
+    tree[mid] = { order[mid], split_dim };
+
+    build_tree(lo, mid, order);
+    build_tree(mid + 1, hi, order);
+}
+
+void Empire_Index::Query::offer(int i, double d)
+{
+    if (d < best_dist || (d == best_dist && i < best))
+    {
+        second_dist = best_dist;
+        best_dist = d;
+        best = i;
+    }
+    else if (d < second_dist)
+    {
+        second_dist = d;
+    }
+}
+
+void Empire_Index::search_tree(int lo, int hi, Query& query) const
+{
+    if (lo >= hi)
+        return;
+
+    int mid = (lo + hi) / 2;
+    const Node& node = tree[mid];
+    const double* point = points.data() + static_cast<size_t>(node.point) * dim;
+
+    if (!replaced[node.point])
+        query.offer(node.point, kernels->squared_distance(point, query.location, dim));
+
+    double diff = query.location[node.split_dim] - point[node.split_dim];
+    if (diff < 0)
+    {
+        search_tree(lo, mid, query);
+        if (diff * diff <= query.radius())
+            search_tree(mid + 1, hi, query);
+    }
+    else
+    {
+        search_tree(mid + 1, hi, query);
+        if (diff * diff <= query.radius())
+            search_tree(lo, mid, query);
+    }
+}
+
+void Empire_Index::search(Query& query) const
+{
+    query.best = -1;
+    query.best_dist = std::numeric_limits<double>::infinity();
+    query.second_dist = std::numeric_limits<double>::infinity();
+
+    if (use_tree)
+    {
+        search_tree(0, size(), query);
+    }
+    else
+    {
+        for (int i = 0; i < size(); ++i)
+        {
+            if (!replaced[i])
+                query.offer(i, kernels->squared_distance(points.data() + static_cast<size_t>(i) * dim, query.location, dim));
+        }
+    }
+
+    for (int i : moved)
+        query.offer(i, kernels->squared_distance(emperors[i]->location.data(), query.location, dim));
+}
+
+int Empire_Index::nearest(const double* location) const
+{
+    Query query;
+    query.location = location;
+    query.want_second = false;
+    search(query);
+    return query.best;
+}
+
+int Empire_Index::nearest_two(const double* location, double& nearest_dist, double& second_dist) const
+{
+    Query query;
+    query.location = location;
+    query.want_second = true;
+    search(query);
+    nearest_dist = query.best_dist;
+    second_dist = query.second_dist;
+    return query.best;
+}
+
+void Empire_Index::nearest_batch(const Population_Store& store, const int* rows, int count, int* nearest) const
+{
+    if (use_tree || !moved.empty() || size() == 0)
+    {
+        for (int i = 0; i < count; ++i)
+            nearest[i] = this->nearest(store.row(rows[i]));
+        return;
+    }
+    blocked_nearest(store.positions, store.stride, rows, count, points.data(), size(), dim, nearest, kernels->squared_distance);
+}
+
+int Empire_Index::refine(const double* location, int candidate) const
+{
+    if (moved.empty())
+        return candidate;
+    if (replaced[candidate])
+        return nearest(location);
+
+    Query query;
+    query.location = location;
+    query.want_second = false;
+    query.best = candidate;
+    query.best_dist = kernels->squared_distance(points.data() + static_cast<size_t>(candidate) * dim, location, dim);
+    query.second_dist = std::numeric_limits<double>::infinity();
+    for (int i : moved)
+        query.offer(i, kernels->squared_distance(emperors[i]->location.data(), location, dim));
+    return query.best;
+}
+
+void Empire_Index::replace(int idx, Country* emperor)
+{
+    emperors[idx] = emperor;
+    if (!replaced[idx])
+    {
+        replaced[idx] = 1;
+        moved.push_back(idx);
+    }
+}
@@ -0,0 +1,74 @@
+#ifndef EMPIRE_INDEX_H
+#define EMPIRE_INDEX_H
+
+#include "country.h"
+#include "kernels.h"
+#include <vector>
+
+// Nearest-emperor lookup for mutiny. Built once per iteration over the current
+// empires: a k-d tree for low dimensions, a scan over packed emperor locations
+// otherwise. Emperors replaced by a coup after the build are skipped by the
+// index and checked directly, so queries stay exact without a rebuild.
+class Empire_Index
+{
+    struct Node
+    {
+        int point;
+        int split_dim;
+    };
+
+    int dim;
+    const Phase_Kernels* kernels;
+    bool use_tree;
+
+    std::vector<Country*> emperors;
+    std::vector<double> points;   // emperor locations at build time, dim-wide rows
+    std::vector<Node> tree;       // implicit balanced tree, node of [lo, hi) at (lo + hi) / 2
+    std::vector<char> replaced;
+    std::vector<int> moved;
+
+    struct Query
+    {
+        const double* location;
+        bool want_second;
+        int best;
+        double best_dist;
+        double second_dist;
+
+        void offer(int i, double d);
+        double radius() const { return want_second ? second_dist : best_dist; }
+    };
+
+    void build_tree(int lo, int hi, std::vector<int>& order);
+    void search_tree(int lo, int hi, Query& query) const;
+    void search(Query& query) const;
+
+public:
+    // The k-d tree is used up to this dimension, a scan above it
+    static const int KD_TREE_MAX_DIM = 12;
+
+    Empire_Index();
+
+    void build(const std::vector<Country*>& empires, int dim, const Phase_Kernels* kernels);
+
+    // Position in empires of the emperor nearest to location, ties go to the lower position
+    int nearest(const double* location) const;
+
+    // Same, also reporting the squared distances to the nearest and second nearest emperor
+    int nearest_two(const double* location, double& nearest_dist, double& second_dist) const;
+
+    // Nearest emperor for the store rows listed in rows. Above KD_TREE_MAX_DIM
+    // this is one blocked pass over all rows instead of a query per row.
+    void nearest_batch(const Population_Store& store, const int* rows, int count, int* nearest) const;
+
+    // Correct a batch answer for emperors replaced after the batch was computed
+    int refine(const double* location, int candidate) const;
+
+    // The emperor at position idx of empires was replaced by emperor
+    void replace(int idx, Country* emperor);
+
+    int size() const { return static_cast<int>(emperors.size()); }
+    bool uses_tree() const { return use_tree; }
+};
+
+#endif
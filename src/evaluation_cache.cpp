@@ -0,0 +1,151 @@
+#include "evaluation_cache.h"
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+
+size_t Evaluation_Cache::Key_Hash::operator()(const Key& key) const
+{
+    unsigned long long h = 0x9E3779B97F4A7C15ull;
+    for (long long v : key)
+    {
+        h ^= static_cast<unsigned long long>(v) + 0x9E3779B97F4A7C15ull + (h << 6) + (h >> 2);
+        h *= 0xBF58476D1CE4E5B9ull;
+    }
+    return static_cast<size_t>(h ^ (h >> 31));
+}
+
+Evaluation_Cache::Evaluation_Cache(double tolerance, size_t capacity, int num_shards)
+    : tolerance(tolerance)
+{
+    if (!(tolerance > 0))
+        throw std::invalid_argument("Evaluation_Cache: tolerance must be positive");
+    num_shards = std::max(1, num_shards);
+    shard_capacity = std::max<size_t>(1, (capacity + num_shards - 1) / num_shards);
+    for (int i = 0; i < num_shards; ++i)
+        shards.emplace_back(new Shard());
+}
+
+bool Evaluation_Cache::quantize(const double* location, int dim, Key& key) const
+{
+    // Cells past the range of long long, and inf or NaN, have no key
+    const double limit = 9223372036854775808.0; // 2^63
+    key.resize(dim);
+    for (int d = 0; d < dim; ++d)
+    {
+        double cell = std::floor(location[d] / tolerance);
+        if (!(cell >= -limit && cell < limit))
+            return false;
+        key[d] = static_cast<long long>(cell);
+    }
+    return true;
+}
+
+Evaluation_Cache::Shard& Evaluation_Cache::shard_of(const Key& key)
+{
+    // The low bits pick the bucket inside the shard, fold the high half in here
+    size_t h = Key_Hash()(key);
+    return *shards[(h ^ (h >> (sizeof(size_t) * 4))) % shards.size()];
+}
+
+bool Evaluation_Cache::lookup(const double* location, int dim, double& fitness)
+{
+    Key key;
+    if (!quantize(location, dim, key))
+        return false;
+    Shard& shard = shard_of(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto it = shard.index.find(key);
+    if (it == shard.index.end())
+    {
+        ++shard.misses;
+        return false;
+    }
+    Entry& entry = shard.entries[it->second];
+    entry.referenced = true;
+    fitness = entry.fitness;
+    ++shard.hits;
+    return true;
+}
+
+void Evaluation_Cache::insert(const double* location, int dim, double fitness)
+{
+    Key key;
+    if (!quantize(location, dim, key))
+        return;
+    Shard& shard = shard_of(key);
+    std::lock_guard<std::mutex> guard(shard.lock);
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+    {
+        shard.entries[it->second].fitness = fitness;
+        shard.entries[it->second].referenced = true;
+        return;
+    }
+
+    if (shard.entries.size() < shard_capacity)
+    {
+        shard.index.emplace(key, static_cast<int>(shard.entries.size()));
+        shard.entries.push_back({ std::move(key), fitness, false });
+        return;
+    }
+
+    // CLOCK: give referenced entries a second chance, evict the first one without
+    while (shard.entries[shard.hand].referenced)
+    {
+        shard.entries[shard.hand].referenced = false;
+        shard.hand = (shard.hand + 1) % shard.entries.size();
+    }
+    Entry& victim = shard.entries[shard.hand];
+    shard.index.erase(victim.key);
+    shard.index.emplace(key, static_cast<int>(shard.hand));
+    victim = { std::move(key), fitness, false };
+    shard.hand = (shard.hand + 1) % shard.entries.size();
+}
+
+void Evaluation_Cache::clear()
+{
+    for (auto& shard : shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        shard->index.clear();
+        shard->entries.clear();
+        shard->hand = 0;
+        shard->hits = 0;
+        shard->misses = 0;
+    }
+}
+
+long long Evaluation_Cache::hits() const
+{
+    long long total = 0;
+    for (auto& shard : shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        total += shard->hits;
+    }
+    return total;
+}
+
+long long Evaluation_Cache::misses() const
+{
+    long long total = 0;
+    for (auto& shard : shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        total += shard->misses;
+    }
+    return total;
+}
+
+size_t Evaluation_Cache::size() const
+{
+    size_t total = 0;
+    for (auto& shard : shards)
+    {
+        std::lock_guard<std::mutex> guard(shard->lock);
+        total += shard->entries.size();
+    }
+    return total;
+}
@@ -0,0 +1,65 @@
+#ifndef EVALUATION_CACHE_H
+#define EVALUATION_CACHE_H
+
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <memory>
+#include <cstddef>
+
+// Memoizes objective values for expensive objectives. Locations are quantized
+// to cells of width tolerance, every location in a cell shares one value.
+// The cache holds at most capacity entries and evicts with CLOCK. Entries are
+// split over shards with a lock each, so threads rarely wait on each other.
+class Evaluation_Cache
+{
+    using Key = std::vector<long long>;
+
+    struct Key_Hash
+    {
+        size_t operator()(const Key& key) const;
+    };
+
+    struct Entry
+    {
+        Key key;
+        double fitness;
+        bool referenced;
+    };
+
+    struct Shard
+    {
+        std::mutex lock;
+        std::unordered_map<Key, int, Key_Hash> index;
+        std::vector<Entry> entries;
+        size_t hand = 0;
+        long long hits = 0;
+        long long misses = 0;
+    };
+
+    double tolerance;
+    size_t shard_capacity;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    // False when a coordinate has no cell a long long can index
+    bool quantize(const double* location, int dim, Key& key) const;
+    Shard& shard_of(const Key& key);
+
+public:
+    // Throws std::invalid_argument unless tolerance is positive
+    Evaluation_Cache(double tolerance, size_t capacity, int num_shards = 16);
+
+    // Cached value for the cell of location, counts a hit or a miss. Locations
+    // that cannot be quantized, far out or not finite, are never cached.
+    bool lookup(const double* location, int dim, double& fitness);
+
+    void insert(const double* location, int dim, double fitness);
+
+    void clear();
+
+    long long hits() const;
+    long long misses() const;
+    size_t size() const;
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "history_codec.h"
+#include <array>
+#include <cstring>
+#include <map>
+
+static const uint8_t FORMAT_VERSION = 1;
+static const uint8_t FLAG_FLOAT_POSITIONS = 1;
+
+static const char* const PHASE_NAMES[] = { "Assimilation", "Revolution", "Mutiny", "Imperial War" };
+
+template<class T>
+static void put(std::vector<unsigned char>& buffer, T value)
+{
+    size_t at = buffer.size();
+    buffer.resize(at + sizeof(T));
+    std::memcpy(buffer.data() + at, &value, sizeof(T));
+}
+
+template<class T>
+static T take(const unsigned char*& at)
+{
+    T value;
+    std::memcpy(&value, at, sizeof(T));
+    at += sizeof(T);
+    return value;
+}
+
+static std::array<double, 3> colour_of(const Visual_Country_Snapshot& country)
+{
+    if (country.colour.size() < 3)
+        return { -1.0, -1.0, -1.0 };
+    return { country.colour[0], country.colour[1], country.colour[2] };
+}
+
+void encode_history(const Visual_History& history, int dim, bool float_positions, std::vector<unsigned char>& buffer)
+{
+    // Palette of the colours in use, in order of first appearance
+    std::map<std::array<double, 3>, uint32_t> palette_index;
+    std::vector<std::array<double, 3>> palette;
+    for (const auto& snapshot : history)
+    {
+        for (const auto& country : snapshot.second)
+        {
+            std::array<double, 3> colour = colour_of(country);
+            if (palette_index.emplace(colour, static_cast<uint32_t>(palette.size())).second)
+                palette.push_back(colour);
+        }
+    }
+    uint8_t index_width = palette.size() <= 0x100 ? 1 : (palette.size() <= 0x10000 ? 2 : 4);
+
+    buffer.clear();
+    put<uint8_t>(buffer, FORMAT_VERSION);
+    put<uint8_t>(buffer, float_positions ? FLAG_FLOAT_POSITIONS : 0);
+    put<uint8_t>(buffer, index_width);
+    put<uint8_t>(buffer, 0);
+    put<uint32_t>(buffer, static_cast<uint32_t>(dim));
+    put<uint32_t>(buffer, static_cast<uint32_t>(history.size()));
+    put<uint32_t>(buffer, static_cast<uint32_t>(palette.size()));
+    for (const auto& colour : palette)
+        for (double channel : colour)
+            put<double>(buffer, channel);
+
+    for (const auto& snapshot : history)
+    {
+        const std::string& phase_name = snapshot.first;
+        const std::vector<Visual_Country_Snapshot>& countries = snapshot.second;
+
+        uint8_t phase = static_cast<uint8_t>(History_Phase::Other);
+        for (uint8_t p = 0; p < 4; ++p)
+            if (phase_name == PHASE_NAMES[p])
+                phase = p;
+        put<uint8_t>(buffer, phase);
+        if (phase == static_cast<uint8_t>(History_Phase::Other))
+        {
+            put<uint16_t>(buffer, static_cast<uint16_t>(phase_name.size()));
+            buffer.insert(buffer.end(), phase_name.begin(), phase_name.end());
+        }
+
+        put<uint32_t>(buffer, static_cast<uint32_t>(countries.size()));
+
+        size_t flags_at = buffer.size();
+        buffer.resize(flags_at + (countries.size() + 7) / 8, 0);
+        for (size_t c = 0; c < countries.size(); ++c)
+            if (countries[c].is_emperor)
+                buffer[flags_at + c / 8] |= static_cast<unsigned char>(1u << (c % 8));
+
+        for (const auto& country : countries)
+        {
+            uint32_t index = palette_index[colour_of(country)];
+            if (index_width == 1)
+                put<uint8_t>(buffer, static_cast<uint8_t>(index));
+            else if (index_width == 2)
+                put<uint16_t>(buffer, static_cast<uint16_t>(index));
+            else
+                put<uint32_t>(buffer, index);
+        }
+
+        for (const auto& country : countries)
+        {
+            for (int d = 0; d < dim; ++d)
+            {
+                if (float_positions)
+                    put<float>(buffer, static_cast<float>(country.position[d]));
+                else
+                    put<double>(buffer, country.position[d]);
+            }
+        }
+    }
+}
+
+Visual_History decode_history(const unsigned char* data, size_t size)
+{
+    Visual_History history;
+    if (size == 0)
+        return history;
+
+    const unsigned char* at = data;
+    take<uint8_t>(at);
+    bool float_positions = (take<uint8_t>(at) & FLAG_FLOAT_POSITIONS) != 0;
+    uint8_t index_width = take<uint8_t>(at);
+    take<uint8_t>(at);
+    int dim = static_cast<int>(take<uint32_t>(at));
+    uint32_t snapshot_count = take<uint32_t>(at);
+    uint32_t palette_size = take<uint32_t>(at);
+
+    std::vector<std::vector<double>> palette(palette_size, std::vector<double>(3));
+    for (auto& colour : palette)
+        for (double& channel : colour)
+            channel = take<double>(at);
+
+    history.reserve(snapshot_count);
+    for (uint32_t snap = 0; snap < snapshot_count; ++snap)
+    {
+        uint8_t phase = take<uint8_t>(at);
+        std::string phase_name;
+        if (phase == static_cast<uint8_t>(History_Phase::Other))
+        {
+            uint16_t length = take<uint16_t>(at);
+            phase_name.assign(reinterpret_cast<const char*>(at), length);
+            at += length;
+        }
+        else
+        {
+            phase_name = PHASE_NAMES[phase];
+        }
+
+        uint32_t country_count = take<uint32_t>(at);
+        std::vector<Visual_Country_Snapshot> countries(country_count);
+
+        const unsigned char* flags = at;
+        at += (country_count + 7) / 8;
+        for (uint32_t c = 0; c < country_count; ++c)
+            countries[c].is_emperor = (flags[c / 8] >> (c % 8)) & 1;
+
+        for (auto& country : countries)
+        {
+            uint32_t index;
+            if (index_width == 1)
+                index = take<uint8_t>(at);
+            else if (index_width == 2)
+                index = take<uint16_t>(at);
+            else
+                index = take<uint32_t>(at);
+            country.colour = palette[index];
+        }
+
+        for (auto& country : countries)
+        {
+            country.position.resize(dim);
+            for (int d = 0; d < dim; ++d)
+                country.position[d] = float_positions ? take<float>(at) : take<double>(at);
+        }
+        history.emplace_back(std::move(phase_name), std::move(countries));
+    }
+    return history;
+}
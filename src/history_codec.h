@@ -0,0 +1,37 @@
+#ifndef HISTORY_CODEC_H
+#define HISTORY_CODEC_H
+
+#include "visual_ica.h"
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+using Visual_History = std::vector<std::pair<std::string, std::vector<Visual_Country_Snapshot>>>;
+
+// Phases recorded by Visual_ICA and PICA_MS, anything else is sent by name
+enum class History_Phase : uint8_t
+{
+    Assimilation,
+    Revolution,
+    Mutiny,
+    Imperial_War,
+    Other = 255
+};
+
+// Binary wire format for a visualization history, sent as MPI_BYTE.
+//
+// Header: version, flags, index width, dim, snapshot count, then the colour
+// palette as doubles. Countries of one empire share a colour, so each
+// country carries a palette index instead of its RGB.
+// Snapshot: phase (plus the name for Other), country count, the emperor
+// flags packed eight to a byte, the palette indices, then the positions as
+// float64, or float32 with float_positions.
+//
+// Values are stored in host byte order, every rank must share it.
+void encode_history(const Visual_History& history, int dim, bool float_positions, std::vector<unsigned char>& buffer);
+
+// Decode one history straight from [data, data + size)
+Visual_History decode_history(const unsigned char* data, size_t size);
+
+#endif
@@ -3,27 +3,117 @@
 #include <numeric>
 #include <cmath>
 #include <iostream>
-#include <random>
-#include <ctime>
+
+// Rows handed to a phase kernel per call, bounds the revolution noise buffer
+static const int KERNEL_BLOCK = 64;
 
 ICA::ICA(
     int pop_size, int dim, int max_iter,
     double beta, double gamma, double eta,
     double lb, double ub,
-    const std::function<double(const std::vector<double>&)>& obj_func
-): pop_size(pop_size), dim(dim), max_iter(max_iter), beta(beta), gamma(gamma), eta(eta), lb(lb), ub(ub), obj_func(obj_func), best_fitness(INFINITY), tp(-1){}
+    const std::function<double(const std::vector<double>&)>& obj_func,
+    unsigned long long seed
+): pop_size(pop_size), dim(dim), max_iter(max_iter), beta(beta), gamma(gamma), eta(eta), lb(lb), ub(ub), obj_func(obj_func), batch_obj_func(make_batch_objective(obj_func)), store(pop_size, dim), kernels(&phase_kernels_for_dim(dim)), use_distance_bounds(false), seed(seed), evaluations(0), evaluations_saved(0), best_fitness(INFINITY), tp(-1)
+{
+    seed_streams(0, 1);
+}
+
+ICA::ICA(
+    int pop_size, int dim, int max_iter,
+    double beta, double gamma, double eta,
+    double lb, double ub,
+    const Batch_Objective_Function& batch_obj_func,
+    unsigned long long seed
+): pop_size(pop_size), dim(dim), max_iter(max_iter), beta(beta), gamma(gamma), eta(eta), lb(lb), ub(ub), obj_func(make_single_objective(batch_obj_func)), batch_obj_func(batch_obj_func), store(pop_size, dim), kernels(&phase_kernels_for_dim(dim)), use_distance_bounds(false), seed(seed), evaluations(0), evaluations_saved(0), best_fitness(INFINITY), tp(-1)
+{
+    seed_streams(0, 1);
+}
+
+void ICA::seed_streams(int island, int num_streams)
+{
+    this->island = island;
+    rng_streams.clear();
+    for (int t = 0; t < num_streams; ++t)
+        rng_streams.emplace_back(seed, (static_cast<unsigned long long>(island) << 32) | static_cast<unsigned>(t));
+}
 
 void ICA::calculate_fitness()
 {
-    for (auto& c : population)
+    std::vector<Fitness_Change> changed;
+    int evaluated = evaluate_dirty(0, store.size, batch_obj_func, changed);
+    evaluations += evaluated;
+    evaluations_saved += store.size - evaluated;
+    update_best(0, store.size);
+    apply_fitness_changes(changed);
+}
+
+void ICA::apply_fitness_changes(const std::vector<Fitness_Change>& changed)
+{
+    for (const Fitness_Change& change : changed)
+    {
+        Country* country = store.countries[change.slot];
+        if (Country* emperor = country->vassal_of_empire)
+            emperor->vassal_fitness_changed(country, change.old_fitness);
+    }
+}
+
+int ICA::evaluate_dirty(int first, int last, const Batch_Objective_Function& objective, std::vector<Fitness_Change>& changed)
+{
+    std::vector<int> rows;
+    for (int slot = first; slot < last; ++slot)
+    {
+        if (!store.dirty[slot])
+            continue;
+        store.dirty[slot] = 0;
+        changed.push_back({ slot, store.fitness[slot] });
+        if (!evaluation_cache || !evaluation_cache->lookup(store.row(slot), dim, store.fitness[slot]))
+            rows.push_back(slot);
+    }
+    int count = static_cast<int>(rows.size());
+
+    if (count == last - first)
+    {
+        if (count > 0)
+            objective(store.row(first), count, dim, store.stride, store.fitness.data() + first);
+    }
+    else if (count > 0)
+    {
+        // Pack the scattered rows so the objective still sees a single batch
+        std::vector<double> packed(static_cast<size_t>(count) * store.stride);
+        std::vector<double> values(count);
+        for (int r = 0; r < count; ++r)
+            std::copy(store.row(rows[r]), store.row(rows[r]) + dim, packed.begin() + static_cast<size_t>(r) * store.stride);
+        objective(packed.data(), count, dim, store.stride, values.data());
+        for (int r = 0; r < count; ++r)
+            store.fitness[rows[r]] = values[r];
+    }
+
+    if (evaluation_cache)
+    {
+        for (int slot : rows)
+            evaluation_cache->insert(store.row(slot), dim, store.fitness[slot]);
+    }
+    return count;
+}
+
+void ICA::enable_evaluation_cache(double tolerance, size_t capacity)
+{
+    evaluation_cache.reset(new Evaluation_Cache(tolerance, capacity));
+}
+
+void ICA::update_best(int first, int last)
+{
+    int best_slot = -1;
+    for (int slot = first; slot < last; ++slot)
     {
-        c->evaluate_fitness(obj_func);
-        if (c->fitness < best_fitness)
+        if (store.fitness[slot] < best_fitness)
         {
-            best_fitness = c->fitness;
-            best_solution = c->location;
+            best_fitness = store.fitness[slot];
+            best_slot = slot;
         }
     }
+    if (best_slot >= 0)
+        best_solution.assign(store.row(best_slot), store.row(best_slot) + dim);
 }
 
 void ICA::create_empires()
@@ -33,7 +123,10 @@ void ICA::create_empires()
 
     double total_power = 0;
     for (auto& e : empires)
+    {
+        store.found_empire(e->slot);
         total_power += std::abs(e->fitness);
+    }
     this->tp = total_power;
 }
 
@@ -59,7 +152,7 @@ void ICA::create_colonies()
 
     std::vector<int> indices(colonies.size());
     std::iota(indices.begin(), indices.end(), 0);
-    std::shuffle(indices.begin(), indices.end(), std::default_random_engine(std::random_device{}()));
+    std::shuffle(indices.begin(), indices.end(), rng());
 
     int idx = 0;
     for (size_t i = 0; i < empires.size(); ++i)
@@ -74,100 +167,121 @@ void ICA::create_colonies()
 
 void ICA::assimilation()
 {
-    for (auto& colony : colonies)
-    {
-        Country* emperor = colony->vassal_of_empire;
-        double dist = 0;
-
-        for (size_t i = 0; i < dim; ++i)
-            dist += std::pow(emperor->location[i] - colony->location[i], 2);
-        dist = std::sqrt(dist);
-
+    for (size_t i = 0; i < empires.size(); ++i)
+        assimilation_of_empire(i);
+}
 
-        if (dist != 0)
-        {
-            double shift = ((double)rand() / RAND_MAX) * this->beta * dist;
-            for (size_t i = 0; i < dim; ++i)
-                colony->location[i] += shift * (emperor->location[i] - colony->location[i]) / dist;
-        }
-    }
+void ICA::assimilation_of_empire(int idx, int stream)
+{
+    assimilation_of_vassals(idx, 0, static_cast<int>(empires[idx]->vassals.size()), rng(stream));
 }
 
-void ICA::assimilation_of_empire(int idx)
+void ICA::assimilation_of_vassals(int idx, int first, int count, RNG& gen)
 {
     Country* emperor = empires[idx];
-    for (auto& vassal : emperor->vassals)
-    {
-        double dist = 0;
-
-        for (size_t i = 0; i < dim; ++i)
-            dist += std::pow(emperor->location[i] - vassal->location[i], 2);
-        dist = std::sqrt(dist);
+    const std::pmr::vector<Country*>& vassals = emperor->vassals;
 
+    std::vector<int> rows(count);
+    for (int r = 0; r < count; ++r)
+        rows[r] = vassals[first + r]->slot;
 
-        if (dist != 0)
-        {
-            double shift = ((double)rand() / RAND_MAX) * this->beta * dist;
-            for (size_t i = 0; i < dim; ++i)
-                vassal->location[i] += shift * (emperor->location[i] - vassal->location[i]) / dist;
-        }
-    }
+    std::vector<double> uniforms(count);
+    gen.fill_uniform(uniforms.data(), count);
+    kernels->assimilate(store.positions, store.stride, rows.data(), count, emperor->location.data(), dim, beta, uniforms.data());
+    for (int slot : rows)
+        store.dirty[slot] = 1;
 }
 
 void ICA::revolution()
 {
-    for (auto& colony : colonies)
-    {
-        for (size_t i = 0; i < dim; ++i)
-            colony->location[i] += ((double)rand() / RAND_MAX) * 2 * gamma - gamma;
-    }
+    for (size_t i = 0; i < empires.size(); ++i)
+        revolution_of_empire(i);
 }
 
-void ICA::revolution_of_empire(int idx)
+void ICA::revolution_of_empire(int idx, int stream)
 {
-    Country* emperor = empires[idx];
-    for (auto& vassal : emperor->vassals)
+    revolution_of_vassals(idx, 0, static_cast<int>(empires[idx]->vassals.size()), rng(stream));
+}
+
+void ICA::revolution_of_vassals(int idx, int first, int count, RNG& gen)
+{
+    const std::pmr::vector<Country*>& vassals = empires[idx]->vassals;
+
+    // Noise is drawn for a block of vassals at a time
+    std::vector<int> rows(KERNEL_BLOCK);
+    std::vector<double> noise(static_cast<size_t>(KERNEL_BLOCK) * dim);
+    for (int done = 0; done < count; done += KERNEL_BLOCK)
     {
-        for (size_t i = 0; i < dim; ++i)
-            vassal->location[i] += ((double)rand() / RAND_MAX) * 2 * gamma - gamma;
+        int block = std::min(KERNEL_BLOCK, count - done);
+        for (int r = 0; r < block; ++r)
+            rows[r] = vassals[first + done + r]->slot;
+
+        gen.fill_uniform(noise.data(), static_cast<size_t>(block) * dim, -gamma, gamma);
+        kernels->revolve(store.positions, store.stride, rows.data(), block, dim, noise.data());
+        for (int r = 0; r < block; ++r)
+            store.dirty[rows[r]] = 1;
     }
 }
 
+RNG ICA::task_rng(unsigned long long epoch, int empire, int chunk) const
+{
+    // Tasks get their own streams above the per-thread ones, so a result does
+    // not depend on which thread ran the task. The full island, epoch, empire
+    // and chunk are hashed into 63 bits under a marker bit, so no field is
+    // truncated and distinct tasks only share a stream by a 2^-63 accident.
+    uint64_t h = splitmix64(static_cast<uint64_t>(static_cast<unsigned>(island)));
+    h = splitmix64(h ^ epoch);
+    h = splitmix64(h ^ static_cast<unsigned>(empire));
+    h = splitmix64(h ^ static_cast<unsigned>(chunk));
+    unsigned long long stream = (1ull << 63) | (h >> 1);
+    return RNG(seed, stream);
+}
+
 void ICA::mutiny()
 {
-    for (Country* colony : colonies)
+    empire_index.build(empires, dim, kernels);
+    if (use_distance_bounds)
+        distance_bounds.begin_pass(empires, store, kernels);
+
+    // Without a tree, answer every colony in one blocked pass up front
+    bool batched = !use_distance_bounds && !empire_index.uses_tree();
+    std::vector<int> batch_nearest;
+    if (batched)
     {
-        Country* nearest_imperialist = *std::min_element(empires.begin(), empires.end(), [&](Country* a, Country* b)
-            {
-                double country_a = 0;
-                double country_b = 0;
-                for (size_t i = 0; i < dim; ++i)
-                {
-                    country_a += std::pow(a->location[i] - colony->location[i], 2);
-                    country_b += std::pow(b->location[i] - colony->location[i], 2);
-                }
-                return country_a < country_b;
-            });
-
-        if (colony->vassal_of_empire != nearest_imperialist)
-        {
-            std::vector<Country*>& vassals = colony->vassal_of_empire->vassals;
-            auto idx = std::find(vassals.begin(), vassals.end(), colony);
-            if (idx != vassals.end())
-                vassals.erase(idx);
-        }
+        std::vector<int> rows(colonies.size());
+        for (size_t c = 0; c < colonies.size(); ++c)
+            rows[c] = colonies[c]->slot;
+        batch_nearest.resize(colonies.size());
+        empire_index.nearest_batch(store, rows.data(), rows.size(), batch_nearest.data());
+    }
+
+    for (size_t c = 0; c < colonies.size(); ++c)
+    {
+        Country* colony = colonies[c];
+        int nearest_idx;
+        if (use_distance_bounds)
+            nearest_idx = distance_bounds.nearest(colony->slot, colony->location.data(), empire_index, empires);
+        else if (batched)
+            nearest_idx = empire_index.refine(colony->location.data(), batch_nearest[c]);
+        else
+            nearest_idx = empire_index.nearest(colony->location.data());
+        Country* nearest_imperialist = empires[nearest_idx];
+
+        bool changes_empire = (colony->vassal_of_empire != nearest_imperialist);
+        if (changes_empire)
+            colony->vassal_of_empire->remove_vassal(colony);
 
         if (colony->fitness < nearest_imperialist->fitness)
         {
             colony->coup(nearest_imperialist);
 
-            auto empire_idx = std::find(empires.begin(), empires.end(), nearest_imperialist);
-            *empire_idx = colony;
-
-            auto colony_idx = std::find(colonies.begin(), colonies.end(), colony);
-            *colony_idx = nearest_imperialist;
+            empires[nearest_idx] = colony;
+            empire_index.replace(nearest_idx, colony);
+            if (use_distance_bounds)
+                distance_bounds.replace(nearest_idx, colony);
+            colonies[c] = nearest_imperialist;
         }
-        else
+        else if (changes_empire)
         {
             colony->add_emperor(nearest_imperialist);
             nearest_imperialist->add_vassal(colony);
@@ -183,10 +297,7 @@ void ICA::imperial_war()
 
     for (size_t i = 0; i < empires.size(); ++i)
     {
-        double vassal_sum = 0;
-        for (auto& v : empires[i]->vassals)
-            vassal_sum += v->fitness;
-        total_power[i] = empires[i]->fitness + eta * vassal_sum;
+        total_power[i] = empires[i]->fitness + eta * empires[i]->vassal_fitness_sum;
         if (total_power[i] > max_power)
             max_power = total_power[i];
     }
@@ -199,9 +310,10 @@ void ICA::imperial_war()
         sum_norm_power += power - max_power;
     }
 
+    RNG& gen = rng();
     std::vector<double> D;
     for (auto norm : normalized_powers)
-        D.push_back(norm / sum_norm_power - ((double)rand() / RAND_MAX));
+        D.push_back(norm / sum_norm_power - gen.uniform());
 
     int weakest_emp_idx = std::min_element(D.begin(), D.end()) - D.begin();
     int strongest_emp_idx = std::max_element(D.begin(), D.end()) - D.begin();
@@ -221,21 +333,18 @@ void ICA::imperial_war()
     }
 }
 
-void ICA::setup()
+void ICA::reserve_countries()
 {
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
+    country_arena.reserve(pop_size, sizeof(Country), alignof(Country));
+}
 
-    for (size_t i = 0; i < pop_size; ++i)
-    {
-        std::vector<double> pos(dim);
-        for (int j = 0; j < dim; ++j)
-        {
-            double r = static_cast<double>(std::rand()) / (RAND_MAX + 1.0);
-            pos[j] = lb + r * (ub - lb);
-        }
-        population.push_back(new Country(pos));
-    }
+Country* ICA::create_country(int slot)
+{
+    return new (country_arena.storage(slot)) Country(store, slot, country_arena.resource());
+}
 
+void ICA::form_empires()
+{
     calculate_fitness();
     std::sort(population.begin(), population.end(), [](Country* a, Country* b)
         {
@@ -245,6 +354,18 @@ void ICA::setup()
     create_colonies();
 }
 
+void ICA::setup()
+{
+    reserve_countries();
+    for (size_t i = 0; i < pop_size; ++i)
+    {
+        rng().fill_uniform(store.row(i), dim, lb, ub);
+        population.push_back(create_country(i));
+    }
+
+    form_empires();
+}
+
 void ICA::run()
 {
     for (int i = 0; i < max_iter; ++i)
@@ -261,14 +382,130 @@ void ICA::run()
 
 void ICA::migrate_best(const std::vector<double>& elite_solution, const std::function<double(const std::vector<double>&)>& obj_func)
 {
-    auto worst = std::max_element(population.begin(), population.end(), [](Country* a, Country* b)
+    // Emperors stay, replacing one would leave the empire index and the
+    // distance bounds pointing at a location the empire no longer has
+    Country* worst_country = nullptr;
+    for (Country* country : population)
+        if (!store.is_emperor(country->slot) && (!worst_country || country->fitness > worst_country->fitness))
+            worst_country = country;
+    if (!worst_country)
+        return;
+
+    worst_country->location = elite_solution;
+    worst_country->evaluate_fitness(obj_func);
+    evaluations += 1;
+}
+
+void ICA::migrate_best(const std::vector<double>& elite_solution, double elite_fitness)
+{
+    std::vector<double> record(elite_solution.begin(), elite_solution.begin() + dim);
+    record.push_back(elite_fitness);
+    receive_elites(record.data(), 1, Receive_Policy::Replace_Worst);
+}
+
+std::vector<double> ICA::pack_elites(int k) const
+{
+    // Only evaluated countries, one moved since still carries the fitness of
+    // where it was and the receiver trusts what it gets
+    k = std::min(k, static_cast<int>(population.size()));
+    std::vector<Country*> ranked;
+    ranked.reserve(population.size());
+    for (Country* country : population)
+        if (!store.dirty[country->slot])
+            ranked.push_back(country);
+    int clean = std::min(k, static_cast<int>(ranked.size()));
+    std::partial_sort(ranked.begin(), ranked.begin() + clean, ranked.end(), [](Country* a, Country* b)
         {
             return a->fitness < b->fitness;
         });
 
-    Country* worst_country = *worst; 
-    worst_country->location = elite_solution;
-    worst_country->evaluate_fitness(obj_func);
+    std::vector<double> records;
+    records.reserve(static_cast<size_t>(k) * (dim + 1));
+    for (int i = 0; i < clean; ++i)
+    {
+        records.insert(records.end(), ranked[i]->location.begin(), ranked[i]->location.end());
+        records.push_back(ranked[i]->fitness);
+    }
+
+    // Too few evaluated countries, the best found so far fills the packet
+    if (!best_solution.empty())
+    {
+        for (int i = clean; i < k; ++i)
+        {
+            records.insert(records.end(), best_solution.begin(), best_solution.end());
+            records.push_back(best_fitness);
+        }
+    }
+    return records;
+}
+
+std::vector<Country*> ICA::migration_targets(int count, Receive_Policy policy)
+{
+    auto worse = [](Country* a, Country* b)
+        {
+            return a->fitness > b->fitness;
+        };
+    std::vector<Country*> targets;
+
+    if (policy == Receive_Policy::Replace_Random)
+    {
+        std::vector<Country*> candidates;
+        for (Country* country : population)
+            if (!store.is_emperor(country->slot))
+                candidates.push_back(country);
+
+        // Partial Fisher-Yates over the non-emperors
+        RNG& gen = rng();
+        int n = static_cast<int>(candidates.size());
+        for (int i = 0; i < std::min(count, n); ++i)
+        {
+            int j = i + static_cast<int>(gen.uniform() * (n - i));
+            std::swap(candidates[i], candidates[std::min(j, n - 1)]);
+            targets.push_back(candidates[i]);
+        }
+    }
+    else if (policy == Receive_Policy::Replace_Weakest_Empire && !empires.empty())
+    {
+        // Highest total cost, the same power imperial_war uses
+        Country* weakest = empires[0];
+        for (Country* empire : empires)
+            if (empire->fitness + eta * empire->vassal_fitness_sum > weakest->fitness + eta * weakest->vassal_fitness_sum)
+                weakest = empire;
+
+        targets.assign(weakest->vassals.begin(), weakest->vassals.end());
+        int k = std::min(count, static_cast<int>(targets.size()));
+        std::partial_sort(targets.begin(), targets.begin() + k, targets.end(), worse);
+        targets.resize(k);
+    }
+
+    // Replace_Worst, and the rest when the policy found too few countries.
+    // Emperors are never replaced, so the empire index and the distance
+    // bounds stay valid.
+    if (static_cast<int>(targets.size()) < count)
+    {
+        std::vector<Country*> ranked;
+        for (Country* country : population)
+            if (!store.is_emperor(country->slot) && std::find(targets.begin(), targets.end(), country) == targets.end())
+                ranked.push_back(country);
+        int k = std::min(count - static_cast<int>(targets.size()), static_cast<int>(ranked.size()));
+        std::partial_sort(ranked.begin(), ranked.begin() + k, ranked.end(), worse);
+        targets.insert(targets.end(), ranked.begin(), ranked.begin() + k);
+    }
+    return targets;
+}
+
+void ICA::receive_elites(const double* records, int count, Receive_Policy policy)
+{
+    std::vector<Country*> targets = migration_targets(count, policy);
+    for (size_t i = 0; i < targets.size(); ++i)
+    {
+        const double* record = records + i * (dim + 1);
+        Country* country = targets[i];
+        std::copy(record, record + dim, country->location.begin());
+        country->set_fitness(record[dim]);
+        update_best(country->slot, country->slot + 1);
+    }
+    evaluations_saved += static_cast<long long>(targets.size());
 }
 
 double ICA::get_fitness()
@@ -276,6 +513,11 @@ double ICA::get_fitness()
     return this->best_fitness;
 }
 
+long long ICA::get_evaluations_saved()
+{
+    return this->evaluations_saved;
+}
+
 std::vector<double> ICA::get_best_solution()
 {
     return this->best_solution;
@@ -315,6 +557,7 @@ void ICA::check(int rank)
 
 ICA::~ICA()
 {
+    // The arena releases the storage itself
     for (auto c : population) 
-        delete c;
+        c->~Country();
 }
@@ -2,8 +2,33 @@
 #define ICA_H
 
 #include "Country.h"
+#include "population_store.h"
+#include "objective.h"
+#include "rng.h"
+#include "kernels.h"
+#include "empire_index.h"
+#include "distance_bounds.h"
+#include "evaluation_cache.h"
+#include "country_arena.h"
 #include <vector>
 #include <functional>
+#include <memory>
+
+// Where migrants land on the receiving island, none of them is evaluated
+// again. Emperors are never replaced.
+enum class Receive_Policy
+{
+    Replace_Worst,              // the worst countries other than emperors
+    Replace_Random,             // random countries other than emperors
+    Replace_Weakest_Empire      // the worst vassals of the empire with the highest total cost
+};
+
+// A slot whose fitness was replaced, with the value it had before
+struct Fitness_Change
+{
+    int slot;
+    double old_fitness;
+};
 
 class ICA
 {
@@ -12,7 +37,28 @@ public:
     int dim; 
     int max_iter;
     std::function<double(const std::vector<double>&)> obj_func;
+    Batch_Objective_Function batch_obj_func;
+    Population_Store store;
+    Country_Arena country_arena;
     std::vector<Country*> population, empires, colonies;
+    const Phase_Kernels* kernels;
+    Empire_Index empire_index;
+
+    // Skip the nearest-emperor search in mutiny when the tracked bounds allow it
+    bool use_distance_bounds;
+    Distance_Bounds distance_bounds;
+
+    // One generator stream per thread, keyed by (seed, island, thread)
+    unsigned long long seed;
+    int island;
+    std::vector<RNG> rng_streams;
+
+    // Objective calls made and skipped because the country had not moved or was cached
+    long long evaluations;
+    long long evaluations_saved;
+
+    // Optional memo in front of the objective, off unless enabled
+    std::unique_ptr<Evaluation_Cache> evaluation_cache;
 
     std::vector<double> best_solution;
     double best_fitness;
@@ -27,31 +73,92 @@ public:
 
     void calculate_fitness();
 
+    // Evaluate the dirty slots in [first, last) with one batch call, returns how
+    // many. Every slot that got a new fitness, from the objective or the cache,
+    // is appended to changed.
+    int evaluate_dirty(int first, int last, const Batch_Objective_Function& objective, std::vector<Fitness_Change>& changed);
+
+    // Pick up improvements among the evaluated slots [first, last)
+    void update_best(int first, int last);
+
+    // Update the aggregates of the empires whose vassals changed fitness
+    void apply_fitness_changes(const std::vector<Fitness_Change>& changed);
+
     virtual void create_empires();
 
     virtual void create_colonies();
 
+    // Reserve arena storage for pop_size countries of the type create_country makes
+    virtual void reserve_countries();
+
+    // Construct the view for a slot of the store in the arena
+    virtual Country* create_country(int slot);
+
+    // Evaluate the initial population and split it into empires and colonies
+    virtual void form_empires();
+
     void assimilation();
 
-    void assimilation_of_empire(int idx);
+    void assimilation_of_empire(int idx, int stream = 0);
+
+    // Assimilate vassals [first, first + count) of empire idx with draws from gen
+    void assimilation_of_vassals(int idx, int first, int count, RNG& gen);
 
     void revolution();
 
-    void revolution_of_empire(int idx);
+    void revolution_of_empire(int idx, int stream = 0);
+
+    void revolution_of_vassals(int idx, int first, int count, RNG& gen);
+
+    // Generator for one chunk of an empire in a scheduled phase, epoch tells phases apart
+    RNG task_rng(unsigned long long epoch, int empire, int chunk) const;
 
     void mutiny();
 
     void imperial_war();
 
-    ICA(int pop_size, int dim, int max_iter, double beta, double gamma, double eta, double lb, double ub, const std::function<double(const std::vector<double>&)>& obj_func);
+    ICA(int pop_size, int dim, int max_iter, double beta, double gamma, double eta, double lb, double ub, const std::function<double(const std::vector<double>&)>& obj_func, unsigned long long seed = random_seed());
+    ICA(int pop_size, int dim, int max_iter, double beta, double gamma, double eta, double lb, double ub, const Batch_Objective_Function& batch_obj_func, unsigned long long seed = random_seed());
+
+    // Objective type resolved at compile time, see make_static_batch_objective
+    template<class Objective, class = std::enable_if_t<is_single_objective_v<Objective>>>
+    ICA(int pop_size, int dim, int max_iter, double beta, double gamma, double eta, double lb, double ub, Objective objective, unsigned long long seed = random_seed())
+        : ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, make_static_batch_objective(objective), seed)
+    {
+        obj_func = make_static_objective(objective);
+    }
+
+    // Recreate the generator streams for an island with the given number of threads
+    void seed_streams(int island, int num_streams);
+
+    RNG& rng(int stream = 0) { return rng_streams[stream]; }
+
+    // Answer evaluations of locations within tolerance of a cached one from the cache
+    void enable_evaluation_cache(double tolerance, size_t capacity);
 
     virtual void setup();
 
     virtual void run();
 
+    // Replace the worst country other than an emperor with the elite
     void migrate_best(const std::vector<double>& elite_solution, const std::function<double(const std::vector<double>&)>& obj_func);
 
+    // Same, taking the fitness the sender already knows instead of evaluating
+    void migrate_best(const std::vector<double>& elite_solution, double elite_fitness);
+
+    // The k best evaluated countries as records of dim location values followed
+    // by the fitness, best first. Countries moved since their last evaluation
+    // are left out and the best solution so far makes up for any shortfall.
+    std::vector<double> pack_elites(int k) const;
+
+    // Place count records laid out as by pack_elites, trusting their fitness
+    void receive_elites(const double* records, int count, Receive_Policy policy);
+
+    // Countries the next count migrants replace under policy
+    std::vector<Country*> migration_targets(int count, Receive_Policy policy);
+
     double get_fitness();
+    long long get_evaluations_saved();
     std::vector<double> get_best_solution();
 
     void set_max_iter(int max_iter);
@@ -0,0 +1,397 @@
+#include "kernels.h"
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ICA_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+#if defined(__GNUC__)
+#define ICA_ALWAYS_INLINE inline __attribute__((always_inline))
+#else
+#define ICA_ALWAYS_INLINE inline
+#endif
+
+// ============================================================================
+// Scalar fallback
+// ============================================================================
+
+static double squared_distance_scalar(const double* a, const double* b, int dim)
+{
+    double sum = 0;
+    for (int d = 0; d < dim; ++d)
+    {
+        double diff = a[d] - b[d];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+static void assimilate_scalar(double* positions, int stride, const int* rows, int count,
+    const double* target, int dim, double beta, const double* uniforms)
+{
+    for (int r = 0; r < count; ++r)
+    {
+        double* x = positions + static_cast<size_t>(rows[r]) * stride;
+        double factor = uniforms[r] * beta;
+        for (int d = 0; d < dim; ++d)
+            x[d] += factor * (target[d] - x[d]);
+    }
+}
+
+static void revolve_scalar(double* positions, int stride, const int* rows, int count,
+    int dim, const double* noise)
+{
+    for (int r = 0; r < count; ++r)
+    {
+        double* x = positions + static_cast<size_t>(rows[r]) * stride;
+        const double* n = noise + static_cast<size_t>(r) * dim;
+        for (int d = 0; d < dim; ++d)
+            x[d] += n[d];
+    }
+}
+
+#ifdef ICA_X86_DISPATCH
+
+// ============================================================================
+// AVX2 + FMA
+// ============================================================================
+
+__attribute__((target("avx2,fma")))
+static double squared_distance_avx2(const double* a, const double* b, int dim)
+{
+    __m256d acc = _mm256_setzero_pd();
+    int d = 0;
+    for (; d + 4 <= dim; d += 4)
+    {
+        __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(a + d), _mm256_loadu_pd(b + d));
+        acc = _mm256_fmadd_pd(diff, diff, acc);
+    }
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(acc), _mm256_extractf128_pd(acc, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    for (; d < dim; ++d)
+    {
+        double diff = a[d] - b[d];
+        sum += diff * diff;
+    }
+    return sum;
+}
+
+__attribute__((target("avx2,fma")))
+static void assimilate_avx2(double* positions, int stride, const int* rows, int count,
+    const double* target, int dim, double beta, const double* uniforms)
+{
+    for (int r = 0; r < count; ++r)
+    {
+        double* x = positions + static_cast<size_t>(rows[r]) * stride;
+        double factor = uniforms[r] * beta;
+        __m256d f = _mm256_set1_pd(factor);
+        int d = 0;
+        for (; d + 4 <= dim; d += 4)
+        {
+            __m256d xv = _mm256_loadu_pd(x + d);
+            __m256d diff = _mm256_sub_pd(_mm256_loadu_pd(target + d), xv);
+            _mm256_storeu_pd(x + d, _mm256_fmadd_pd(f, diff, xv));
+        }
+        for (; d < dim; ++d)
+            x[d] += factor * (target[d] - x[d]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void revolve_avx2(double* positions, int stride, const int* rows, int count,
+    int dim, const double* noise)
+{
+    for (int r = 0; r < count; ++r)
+    {
+        double* x = positions + static_cast<size_t>(rows[r]) * stride;
+        const double* n = noise + static_cast<size_t>(r) * dim;
+        int d = 0;
+        for (; d + 4 <= dim; d += 4)
+            _mm256_storeu_pd(x + d, _mm256_add_pd(_mm256_loadu_pd(x + d), _mm256_loadu_pd(n + d)));
+        for (; d < dim; ++d)
+            x[d] += n[d];
+    }
+}
+
+// ============================================================================
+// AVX-512F
+// ============================================================================
+
+__attribute__((target("avx512f")))
+static double squared_distance_avx512(const double* a, const double* b, int dim)
+{
+    __m512d acc = _mm512_setzero_pd();
+    int d = 0;
+    for (; d + 8 <= dim; d += 8)
+    {
+        __m512d diff = _mm512_sub_pd(_mm512_loadu_pd(a + d), _mm512_loadu_pd(b + d));
+        acc = _mm512_fmadd_pd(diff, diff, acc);
+    }
+    if (d < dim)
+    {
+        __mmask8 tail = static_cast<__mmask8>((1u << (dim - d)) - 1);
+        __m512d diff = _mm512_sub_pd(_mm512_maskz_loadu_pd(tail, a + d), _mm512_maskz_loadu_pd(tail, b + d));
+        acc = _mm512_fmadd_pd(diff, diff, acc);
+    }
+    // Zero-masked extracts, the plain ones start from an undefined register
+    __m256d quad = _mm256_add_pd(_mm512_maskz_extractf64x4_pd(0xF, acc, 0), _mm512_maskz_extractf64x4_pd(0xF, acc, 1));
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(quad), _mm256_extractf128_pd(quad, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+}
+
+__attribute__((target("avx512f")))
+static void assimilate_avx512(double* positions, int stride, const int* rows, int count,
+    const double* target, int dim, double beta, const double* uniforms)
+{
+    for (int r = 0; r < count; ++r)
+    {
+        double* x = positions + static_cast<size_t>(rows[r]) * stride;
+        __m512d f = _mm512_set1_pd(uniforms[r] * beta);
+        int d = 0;
+        for (; d + 8 <= dim; d += 8)
+        {
+            __m512d xv = _mm512_loadu_pd(x + d);
+            __m512d diff = _mm512_sub_pd(_mm512_loadu_pd(target + d), xv);
+            _mm512_storeu_pd(x + d, _mm512_fmadd_pd(f, diff, xv));
+        }
+        if (d < dim)
+        {
+            __mmask8 tail = static_cast<__mmask8>((1u << (dim - d)) - 1);
+            __m512d xv = _mm512_maskz_loadu_pd(tail, x + d);
+            __m512d diff = _mm512_sub_pd(_mm512_maskz_loadu_pd(tail, target + d), xv);
+            _mm512_mask_storeu_pd(x + d, tail, _mm512_fmadd_pd(f, diff, xv));
+        }
+    }
+}
+
+__attribute__((target("avx512f")))
+static void revolve_avx512(double* positions, int stride, const int* rows, int count,
+    int dim, const double* noise)
+{
+    for (int r = 0; r < count; ++r)
+    {
+        double* x = positions + static_cast<size_t>(rows[r]) * stride;
+        const double* n = noise + static_cast<size_t>(r) * dim;
+        int d = 0;
+        for (; d + 8 <= dim; d += 8)
+            _mm512_storeu_pd(x + d, _mm512_add_pd(_mm512_loadu_pd(x + d), _mm512_loadu_pd(n + d)));
+        if (d < dim)
+        {
+            __mmask8 tail = static_cast<__mmask8>((1u << (dim - d)) - 1);
+            __m512d sum = _mm512_add_pd(_mm512_maskz_loadu_pd(tail, x + d), _mm512_maskz_loadu_pd(tail, n + d));
+            _mm512_mask_storeu_pd(x + d, tail, sum);
+        }
+    }
+}
+
+#endif
+
+// ============================================================================
+// Fixed dimensions
+// ============================================================================
+
+// Dim is a compile time constant, so every loop has a known trip count and no
+// tail. The bodies are inlined into one wrapper per instruction set, which the
+// compiler unrolls and vectorizes for that target.
+template<int Dim>
+struct Fixed_Kernels
+{
+    static ICA_ALWAYS_INLINE double distance(const double* a, const double* b)
+    {
+        double sum = 0;
+        for (int d = 0; d < Dim; ++d)
+        {
+            double diff = a[d] - b[d];
+            sum += diff * diff;
+        }
+        return sum;
+    }
+
+    static ICA_ALWAYS_INLINE void move(double* positions, int stride, const int* rows, int count,
+        const double* target, double beta, const double* uniforms)
+    {
+        for (int r = 0; r < count; ++r)
+        {
+            double* x = positions + static_cast<size_t>(rows[r]) * stride;
+            double factor = uniforms[r] * beta;
+            for (int d = 0; d < Dim; ++d)
+                x[d] += factor * (target[d] - x[d]);
+        }
+    }
+
+    static ICA_ALWAYS_INLINE void perturb(double* positions, int stride, const int* rows, int count,
+        const double* noise)
+    {
+        for (int r = 0; r < count; ++r)
+        {
+            double* x = positions + static_cast<size_t>(rows[r]) * stride;
+            const double* n = noise + static_cast<size_t>(r) * Dim;
+            for (int d = 0; d < Dim; ++d)
+                x[d] += n[d];
+        }
+    }
+
+    static double squared_distance_scalar(const double* a, const double* b, int)
+    {
+        return distance(a, b);
+    }
+
+    static void assimilate_scalar(double* positions, int stride, const int* rows, int count,
+        const double* target, int, double beta, const double* uniforms)
+    {
+        move(positions, stride, rows, count, target, beta, uniforms);
+    }
+
+    static void revolve_scalar(double* positions, int stride, const int* rows, int count,
+        int, const double* noise)
+    {
+        perturb(positions, stride, rows, count, noise);
+    }
+
+#ifdef ICA_X86_DISPATCH
+    __attribute__((target("avx2,fma")))
+    static double squared_distance_avx2(const double* a, const double* b, int)
+    {
+        return distance(a, b);
+    }
+
+    __attribute__((target("avx2,fma")))
+    static void assimilate_avx2(double* positions, int stride, const int* rows, int count,
+        const double* target, int, double beta, const double* uniforms)
+    {
+        move(positions, stride, rows, count, target, beta, uniforms);
+    }
+
+    __attribute__((target("avx2,fma")))
+    static void revolve_avx2(double* positions, int stride, const int* rows, int count,
+        int, const double* noise)
+    {
+        perturb(positions, stride, rows, count, noise);
+    }
+
+    __attribute__((target("avx512f")))
+    static double squared_distance_avx512(const double* a, const double* b, int)
+    {
+        return distance(a, b);
+    }
+
+    __attribute__((target("avx512f")))
+    static void assimilate_avx512(double* positions, int stride, const int* rows, int count,
+        const double* target, int, double beta, const double* uniforms)
+    {
+        move(positions, stride, rows, count, target, beta, uniforms);
+    }
+
+    __attribute__((target("avx512f")))
+    static void revolve_avx512(double* positions, int stride, const int* rows, int count,
+        int, const double* noise)
+    {
+        perturb(positions, stride, rows, count, noise);
+    }
+#endif
+
+    static const Phase_Kernels& get(Kernel_Isa isa)
+    {
+        static const Phase_Kernels scalar = {
+            Kernel_Isa::scalar, "scalar", Dim, squared_distance_scalar, assimilate_scalar, revolve_scalar
+        };
+#ifdef ICA_X86_DISPATCH
+        static const Phase_Kernels avx2 = {
+            Kernel_Isa::avx2, "avx2", Dim, squared_distance_avx2, assimilate_avx2, revolve_avx2
+        };
+        static const Phase_Kernels avx512 = {
+            Kernel_Isa::avx512, "avx512", Dim, squared_distance_avx512, assimilate_avx512, revolve_avx512
+        };
+        if (isa == Kernel_Isa::avx512)
+            return avx512;
+        if (isa == Kernel_Isa::avx2)
+            return avx2;
+#endif
+        return scalar;
+    }
+};
+
+// ============================================================================
+// Dispatch
+// ============================================================================
+
+static const Phase_Kernels SCALAR_KERNELS = {
+    Kernel_Isa::scalar, "scalar", 0, squared_distance_scalar, assimilate_scalar, revolve_scalar
+};
+
+#ifdef ICA_X86_DISPATCH
+static const Phase_Kernels AVX2_KERNELS = {
+    Kernel_Isa::avx2, "avx2", 0, squared_distance_avx2, assimilate_avx2, revolve_avx2
+};
+
+static const Phase_Kernels AVX512_KERNELS = {
+    Kernel_Isa::avx512, "avx512", 0, squared_distance_avx512, assimilate_avx512, revolve_avx512
+};
+#endif
+
+bool kernel_isa_supported(Kernel_Isa isa)
+{
+    switch (isa)
+    {
+    case Kernel_Isa::scalar:
+        return true;
+#ifdef ICA_X86_DISPATCH
+    case Kernel_Isa::avx2:
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case Kernel_Isa::avx512:
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+const Phase_Kernels& phase_kernels(Kernel_Isa isa)
+{
+#ifdef ICA_X86_DISPATCH
+    if (isa == Kernel_Isa::avx512 && kernel_isa_supported(isa))
+        return AVX512_KERNELS;
+    if (isa == Kernel_Isa::avx2 && kernel_isa_supported(isa))
+        return AVX2_KERNELS;
+#endif
+    return SCALAR_KERNELS;
+}
+
+const Phase_Kernels& phase_kernels()
+{
+    static const Phase_Kernels& best =
+        kernel_isa_supported(Kernel_Isa::avx512) ? phase_kernels(Kernel_Isa::avx512) :
+        kernel_isa_supported(Kernel_Isa::avx2) ? phase_kernels(Kernel_Isa::avx2) :
+        phase_kernels(Kernel_Isa::scalar);
+    return best;
+}
+
+bool fixed_dim_supported(int dim)
+{
+    return dim == 2 || dim == 8 || dim == 16 || dim == 30;
+}
+
+const Phase_Kernels& phase_kernels(Kernel_Isa isa, int dim)
+{
+    // Unsupported instruction sets resolve to scalar first, as above
+    Kernel_Isa resolved = phase_kernels(isa).isa;
+    switch (dim)
+    {
+    case 2:
+        return Fixed_Kernels<2>::get(resolved);
+    case 8:
+        return Fixed_Kernels<8>::get(resolved);
+    case 16:
+        return Fixed_Kernels<16>::get(resolved);
+    case 30:
+        return Fixed_Kernels<30>::get(resolved);
+    default:
+        return phase_kernels(isa);
+    }
+}
+
+const Phase_Kernels& phase_kernels_for_dim(int dim)
+{
+    return phase_kernels(phase_kernels().isa, dim);
+}
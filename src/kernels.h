@@ -0,0 +1,54 @@
+#ifndef KERNELS_H
+#define KERNELS_H
+
+// Vectorized kernels for the assimilation and revolution phases. They work on
+// rows of the population store: positions is the matrix base, stride the row
+// pitch and rows the slots to process, so a whole empire is handled per call.
+enum class Kernel_Isa
+{
+    scalar,
+    avx2,
+    avx512
+};
+
+struct Phase_Kernels
+{
+    Kernel_Isa isa;
+    const char* name;
+
+    // Dimension the kernels are compiled for, 0 when they take any. Fixed
+    // dimension kernels still receive dim but ignore it.
+    int fixed_dim;
+
+    // Squared euclidean distance between two locations
+    double (*squared_distance)(const double* a, const double* b, int dim);
+
+    // Move row r toward target by uniforms[r] * beta of the way. This is the
+    // classic shift of u * beta * dist along the unit vector to the emperor.
+    void (*assimilate)(double* positions, int stride, const int* rows, int count,
+        const double* target, int dim, double beta, const double* uniforms);
+
+    // Add noise[r * dim + d] to coordinate d of row r
+    void (*revolve)(double* positions, int stride, const int* rows, int count,
+        int dim, const double* noise);
+};
+
+bool kernel_isa_supported(Kernel_Isa isa);
+
+// Kernels for a specific instruction set, falls back to scalar when unsupported
+const Phase_Kernels& phase_kernels(Kernel_Isa isa);
+
+// Best kernels for the running CPU, chosen once on first use
+const Phase_Kernels& phase_kernels();
+
+// Dimensions with kernels compiled for them, with fully unrolled loops
+bool fixed_dim_supported(int dim);
+
+// Kernels for an instruction set and dimension, the dynamic ones when the
+// dimension has no specialization
+const Phase_Kernels& phase_kernels(Kernel_Isa isa, int dim);
+
+// Best kernels for the running CPU and dim
+const Phase_Kernels& phase_kernels_for_dim(int dim);
+
+#endif
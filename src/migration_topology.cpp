@@ -0,0 +1,99 @@
+#include "migration_topology.h"
+#include "rng.h"
+#include <algorithm>
+#include <numeric>
+
+// Sorted, without duplicates, and without rank itself unless it is alone
+static std::vector<int> tidy(std::vector<int> ranks, int rank, int size)
+{
+    std::sort(ranks.begin(), ranks.end());
+    ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+    if (size > 1)
+        ranks.erase(std::remove(ranks.begin(), ranks.end(), rank), ranks.end());
+    return ranks;
+}
+
+Migration_Neighbours migration_neighbours(Migration_Topology topology, int rank, int size,
+    int degree, unsigned long long seed, int cycle)
+{
+    std::vector<int> sources;
+    std::vector<int> destinations;
+    int prev = (rank - 1 + size) % size;
+    int next = (rank + 1) % size;
+
+    switch (topology)
+    {
+    case Migration_Topology::Ring:
+        sources = { prev };
+        destinations = { next };
+        break;
+
+    case Migration_Topology::Bidirectional_Ring:
+        sources = destinations = { prev, next };
+        break;
+
+    case Migration_Topology::Torus_2D:
+    {
+        int rows = 1;
+        for (int r = 1; r * r <= size; ++r)
+            if (size % r == 0)
+                rows = r;
+        int cols = size / rows;
+        int row = rank / cols;
+        int col = rank % cols;
+        destinations = {
+            ((row + rows - 1) % rows) * cols + col,
+            ((row + 1) % rows) * cols + col,
+            row * cols + (col + cols - 1) % cols,
+            row * cols + (col + 1) % cols
+        };
+        sources = destinations;
+        break;
+    }
+
+    case Migration_Topology::Hypercube:
+        for (int bit = 1; bit < size; bit <<= 1)
+            if ((rank ^ bit) < size)
+                destinations.push_back(rank ^ bit);
+        if (destinations.empty())
+            destinations.push_back(rank);
+        sources = destinations;
+        break;
+
+    case Migration_Topology::Random_Regular:
+    {
+        // A circulant graph over a random relabelling of the ranks: rank sends
+        // to the degree ranks after it in the shuffled order and receives from
+        // the degree ranks before it
+        std::vector<int> order(size);
+        std::iota(order.begin(), order.end(), 0);
+        RNG gen(seed, (1ull << 62) | static_cast<unsigned>(cycle));
+        std::shuffle(order.begin(), order.end(), gen);
+        int position = static_cast<int>(std::find(order.begin(), order.end(), rank) - order.begin());
+
+        int k = std::max(1, std::min(degree, size - 1));
+        for (int j = 1; j <= k; ++j)
+        {
+            destinations.push_back(order[(position + j) % size]);
+            sources.push_back(order[((position - j) % size + size) % size]);
+        }
+        break;
+    }
+
+    case Migration_Topology::Fully_Connected:
+        destinations.resize(size);
+        std::iota(destinations.begin(), destinations.end(), 0);
+        sources = destinations;
+        break;
+    }
+
+    Migration_Neighbours neighbours;
+    neighbours.sources = tidy(sources, rank, size);
+    neighbours.destinations = tidy(destinations, rank, size);
+    return neighbours;
+}
+
+bool topology_is_dynamic(Migration_Topology topology)
+{
+    return topology == Migration_Topology::Random_Regular;
+}
@@ -0,0 +1,32 @@
+#ifndef MIGRATION_TOPOLOGY_H
+#define MIGRATION_TOPOLOGY_H
+
+#include <vector>
+
+// Which islands exchange elites in PICA_MP
+enum class Migration_Topology
+{
+    Ring,                   // to the next rank only
+    Bidirectional_Ring,     // to both ring neighbours
+    Torus_2D,               // the four grid neighbours on the squarest rows x cols grid, wrapping around
+    Hypercube,              // ranks differing in one bit, partial when size is not a power of two
+    Random_Regular,         // degree random neighbours, redrawn every cycle
+    Fully_Connected         // to every other rank
+};
+
+struct Migration_Neighbours
+{
+    std::vector<int> sources;       // ranks whose elites this rank receives, ascending
+    std::vector<int> destinations;  // ranks this rank sends its elite to, ascending
+};
+
+// Neighbours of rank among size ranks. Random_Regular is drawn from seed and
+// cycle, so every rank derives the same graph without communicating. A lone
+// rank is its own neighbour, as on the original ring.
+Migration_Neighbours migration_neighbours(Migration_Topology topology, int rank, int size,
+    int degree, unsigned long long seed, int cycle);
+
+// Whether the graph changes from cycle to cycle
+bool topology_is_dynamic(Migration_Topology topology);
+
+#endif
@@ -0,0 +1,177 @@
+#include "numa_topology.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef __linux__
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <cstdlib>
+#endif
+
+Numa_Topology::Numa_Topology()
+    : node_count(1)
+{}
+
+#ifdef __linux__
+// CPUs listed in a sysfs cpulist such as "0-3,8-11"
+static std::vector<int> parse_cpu_list(const std::string& text)
+{
+    std::vector<int> result;
+    std::stringstream ranges(text);
+    std::string range;
+    while (std::getline(ranges, range, ','))
+    {
+        if (range.empty() || range == "\n")
+            continue;
+        size_t dash = range.find('-');
+        int first = std::atoi(range.c_str());
+        int last = dash == std::string::npos ? first : std::atoi(range.c_str() + dash + 1);
+        for (int cpu = first; cpu <= last; ++cpu)
+            result.push_back(cpu);
+    }
+    return result;
+}
+#endif
+
+Numa_Topology Numa_Topology::detect()
+{
+    Numa_Topology topology;
+
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+            if (CPU_ISSET(cpu, &allowed))
+                topology.cpus.push_back(cpu);
+    }
+
+    std::vector<int> node_of(CPU_SETSIZE, 0);
+    if (DIR* dir = opendir("/sys/devices/system/node"))
+    {
+        while (dirent* entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4 || !isdigit(static_cast<unsigned char>(name[4])))
+                continue;
+            int node = std::atoi(name.c_str() + 4);
+            std::ifstream list("/sys/devices/system/node/" + name + "/cpulist");
+            std::string text;
+            std::getline(list, text);
+            for (int cpu : parse_cpu_list(text))
+                if (cpu >= 0 && cpu < CPU_SETSIZE)
+                    node_of[cpu] = node;
+            topology.node_count = std::max(topology.node_count, node + 1);
+        }
+        closedir(dir);
+    }
+
+    // Group by node, keeping the CPU order inside each node
+    std::stable_sort(topology.cpus.begin(), topology.cpus.end(), [&](int a, int b)
+        {
+            return node_of[a] < node_of[b];
+        });
+    for (int cpu : topology.cpus)
+        topology.cpu_node.push_back(node_of[cpu]);
+#endif
+
+    if (topology.cpus.empty())
+    {
+        int n = std::max(1u, std::thread::hardware_concurrency());
+        for (int cpu = 0; cpu < n; ++cpu)
+        {
+            topology.cpus.push_back(cpu);
+            topology.cpu_node.push_back(0);
+        }
+    }
+    return topology;
+}
+
+int Numa_Topology::cpu_for(int worker) const
+{
+    return cpus[worker % cpus.size()];
+}
+
+int Numa_Topology::node_for(int worker) const
+{
+    return cpu_node[worker % cpu_node.size()];
+}
+
+bool Numa_Topology::pin_current_thread(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+Thread_Pin::Thread_Pin(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (cpu < 0 || sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+        return;
+    for (int c = 0; c < CPU_SETSIZE; ++c)
+        if (CPU_ISSET(c, &allowed))
+            saved_cpus.push_back(c);
+    if (!Numa_Topology::pin_current_thread(cpu))
+        saved_cpus.clear();
+#else
+    (void)cpu;
+#endif
+}
+
+Thread_Pin::~Thread_Pin()
+{
+#ifdef __linux__
+    if (saved_cpus.empty())
+        return;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    for (int c : saved_cpus)
+        CPU_SET(c, &allowed);
+    sched_setaffinity(0, sizeof(allowed), &allowed);
+#endif
+}
+
+std::vector<long long> Numa_Topology::pages_per_node(const void* data, size_t bytes) const
+{
+    std::vector<long long> pages;
+#if defined(__linux__) && defined(SYS_move_pages)
+    size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t first = reinterpret_cast<uintptr_t>(data) / page_size * page_size;
+    uintptr_t last = reinterpret_cast<uintptr_t>(data) + bytes;
+
+    std::vector<void*> addresses;
+    for (uintptr_t page = first; page < last; page += page_size)
+        addresses.push_back(reinterpret_cast<void*>(page));
+    std::vector<int> status(addresses.size(), -1);
+
+    // With no target nodes move_pages only reports where each page lives
+    if (syscall(SYS_move_pages, 0, addresses.size(), addresses.data(), nullptr, status.data(), 0) != 0)
+        return pages;
+
+    pages.assign(node_count, 0);
+    for (int node : status)
+        if (node >= 0 && node < node_count)
+            ++pages[node];
+#else
+    (void)data;
+    (void)bytes;
+#endif
+    return pages;
+}
@@ -0,0 +1,48 @@
+#ifndef NUMA_TOPOLOGY_H
+#define NUMA_TOPOLOGY_H
+
+#include <vector>
+#include <cstddef>
+
+// CPUs the process may run on, grouped by NUMA node. On Linux the nodes are
+// read from sysfs, elsewhere, or when sysfs has no node entries, every CPU is
+// reported on node 0 and pinning is a no-op.
+class Numa_Topology
+{
+public:
+    std::vector<int> cpus;          // allowed CPUs, the CPUs of node 0 first
+    std::vector<int> cpu_node;      // node of cpus[i]
+    int node_count;
+
+    Numa_Topology();
+
+    static Numa_Topology detect();
+
+    // Consecutive workers fill the CPUs of one node before moving on to the next
+    int cpu_for(int worker) const;
+    int node_for(int worker) const;
+
+    // Bind the calling thread to one CPU, false when the system refuses
+    static bool pin_current_thread(int cpu);
+
+    // Pages of [data, data + bytes) resident on each node. Pages not yet
+    // touched are not counted, empty when placement cannot be queried.
+    std::vector<long long> pages_per_node(const void* data, size_t bytes) const;
+};
+
+// Pins the calling thread to one CPU for its lifetime and gives back the CPUs
+// it had before, so the pool threads reused by a later parallel region, or by
+// the caller's own code, are not left bound. A negative CPU leaves it alone.
+class Thread_Pin
+{
+    std::vector<int> saved_cpus;    // empty when nothing was pinned
+
+public:
+    explicit Thread_Pin(int cpu);
+    ~Thread_Pin();
+
+    Thread_Pin(const Thread_Pin&) = delete;
+    Thread_Pin& operator=(const Thread_Pin&) = delete;
+};
+
+#endif
@@ -0,0 +1,27 @@
+#include "objective.h"
+#include <algorithm>
+
+Batch_Objective_Function make_batch_objective(const Objective_Function& objective)
+{
+    return [objective](const double* positions, int count, int dim, int stride, double* fitness)
+        {
+            std::vector<double> x(dim);
+            for (int i = 0; i < count; ++i)
+            {
+                const double* row = positions + static_cast<size_t>(i) * stride;
+                std::copy(row, row + dim, x.begin());
+                fitness[i] = objective(x);
+            }
+        };
+}
+
+Objective_Function make_single_objective(const Batch_Objective_Function& objective)
+{
+    return [objective](const std::vector<double>& x)
+        {
+            double fitness;
+            int dim = static_cast<int>(x.size());
+            objective(x.data(), 1, dim, dim, &fitness);
+            return fitness;
+        };
+}
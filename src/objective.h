@@ -0,0 +1,71 @@
+#ifndef OBJECTIVE_H
+#define OBJECTIVE_H
+
+#include <vector>
+#include <functional>
+#include <type_traits>
+
+// Evaluates a single location
+using Objective_Function = std::function<double(const std::vector<double>&)>;
+
+// Evaluates count locations stored row by row, stride doubles apart, writing
+// one fitness value per row. Only the first dim values of a row are coordinates.
+using Batch_Objective_Function = std::function<void(const double* positions, int count, int dim, int stride, double* fitness)>;
+
+// Wrap a per-location objective so a whole block is evaluated per call
+Batch_Objective_Function make_batch_objective(const Objective_Function& objective);
+
+// Evaluate a single location through a batch objective
+Objective_Function make_single_objective(const Batch_Objective_Function& objective);
+
+// Objectives that take a single location, either as a vector or as a
+// pointer to dim coordinates
+template<class Objective>
+constexpr bool is_single_objective_v =
+    std::is_invocable_r_v<double, const Objective&, const std::vector<double>&> ||
+    std::is_invocable_r_v<double, const Objective&, const double*, int>;
+
+// Batch objective around a callable whose type is known at compile time. The
+// per-row call is direct, so a cheap objective inlines into the row loop and
+// the only indirect call left is the one per batch.
+template<class Objective>
+Batch_Objective_Function make_static_batch_objective(Objective objective)
+{
+    return [objective](const double* positions, int count, int dim, int stride, double* fitness)
+        {
+            if constexpr (std::is_invocable_r_v<double, const Objective&, const double*, int>)
+            {
+                for (int i = 0; i < count; ++i)
+                    fitness[i] = objective(positions + static_cast<size_t>(i) * stride, dim);
+            }
+            else
+            {
+                std::vector<double> x(dim);
+                for (int i = 0; i < count; ++i)
+                {
+                    const double* row = positions + static_cast<size_t>(i) * stride;
+                    x.assign(row, row + dim);
+                    fitness[i] = objective(x);
+                }
+            }
+        };
+}
+
+// Single-location adapter of the same callable
+template<class Objective>
+Objective_Function make_static_objective(Objective objective)
+{
+    if constexpr (std::is_invocable_r_v<double, const Objective&, const double*, int>)
+    {
+        return [objective](const std::vector<double>& x)
+            {
+                return objective(x.data(), static_cast<int>(x.size()));
+            };
+    }
+    else
+    {
+        return Objective_Function(objective);
+    }
+}
+
+#endif
@@ -0,0 +1,131 @@
+#include "pica_hybrid.h"
+#include <mpi.h>
+#include <iostream>
+#include <stdexcept>
+
+PICA_Hybrid::PICA_Hybrid(int pop_size, int dim, int max_iter,
+    double beta, double gamma, double eta,
+    double lb, double ub,
+    const std::function<double(const std::vector<double>&)>& obj_func,
+    int migration_cycles, int iterations_per_cycle,
+    int threads_per_rank, bool pin_threads,
+    unsigned long long seed)
+    : migration_cycles(migration_cycles), iterations_per_cycle(iterations_per_cycle), dim(dim), threads_per_rank(threads_per_rank)
+{
+    island.reset(new PICA_MS(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func, false, threads_per_rank, seed));
+    initialize(pin_threads);
+}
+
+PICA_Hybrid::PICA_Hybrid(int pop_size, int dim, int max_iter,
+    double beta, double gamma, double eta,
+    double lb, double ub,
+    const Batch_Objective_Function& batch_obj_func,
+    int migration_cycles, int iterations_per_cycle,
+    int threads_per_rank, bool pin_threads,
+    unsigned long long seed)
+    : migration_cycles(migration_cycles), iterations_per_cycle(iterations_per_cycle), dim(dim), threads_per_rank(threads_per_rank)
+{
+    island.reset(new PICA_MS(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, batch_obj_func, false, threads_per_rank, seed));
+    initialize(pin_threads);
+}
+
+void PICA_Hybrid::initialize(bool pin_threads)
+{
+    int provided;
+    MPI_Query_thread(&provided);
+    if (provided < MPI_THREAD_FUNNELED)
+        throw std::runtime_error("PICA_Hybrid: MPI must be initialized with MPI_Init_thread and at least MPI_THREAD_FUNNELED");
+
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // Ranks sharing a node split its cores between them
+    MPI_Comm node_comm;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node_comm);
+    MPI_Comm_rank(node_comm, &local_rank);
+    MPI_Comm_free(&node_comm);
+
+    timing = { 0, 0 };
+
+    // Every rank is its own island with its own streams
+    island->set_island(rank);
+    if (pin_threads)
+        island->enable_numa(local_rank * threads_per_rank);
+    island->setup_parallel();
+}
+
+void PICA_Hybrid::run()
+{
+    double start = MPI_Wtime();
+    island->run_parallel();
+    island->set_max_iter(iterations_per_cycle);
+    timing.compute += MPI_Wtime() - start;
+
+    for (int cycle = 0; cycle < migration_cycles; ++cycle)
+    {
+        start = MPI_Wtime();
+        int prev = (rank - 1 + size) % size;
+        int next = (rank + 1) % size;
+        int tag = 0;
+
+        // A blocking ring exchange of the single best, the migration happens
+        // between runs when every thread is idle anyway. The fitness travels
+        // with the solution so the receiver does not re-evaluate it.
+        std::vector<double> send_solution = island->get_best_solution();
+        send_solution.push_back(island->get_best_fitness());
+        std::vector<double> recv_solution(dim + 1);
+
+        MPI_Sendrecv(send_solution.data(), dim + 1, MPI_DOUBLE, next, tag, recv_solution.data(), dim + 1, MPI_DOUBLE, prev, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+        timing.communication += MPI_Wtime() - start;
+
+        start = MPI_Wtime();
+        double recv_fitness = recv_solution.back();
+        recv_solution.pop_back();
+        island->migrate_best(recv_solution, recv_fitness);
+        island->run_parallel();
+        timing.compute += MPI_Wtime() - start;
+    }
+}
+
+Hybrid_Timing PICA_Hybrid::get_timing() const
+{
+    return timing;
+}
+
+void PICA_Hybrid::report_timing()
+{
+    double local[2] = { timing.compute, timing.communication };
+    double low[2], high[2], sum[2];
+    MPI_Reduce(local, low, 2, MPI_DOUBLE, MPI_MIN, 0, MPI_COMM_WORLD);
+    MPI_Reduce(local, high, 2, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(local, sum, 2, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    if (rank == 0)
+    {
+        const char* names[2] = { "Compute", "Communication" };
+        std::cout << size << " ranks x " << threads_per_rank << " threads" << std::endl;
+        for (int i = 0; i < 2; ++i)
+        {
+            std::cout << names[i] << " time: min " << low[i] << " s, max " << high[i]
+                << " s, mean " << sum[i] / size << " s" << std::endl;
+        }
+        double total = sum[0] + sum[1];
+        if (total > 0)
+            std::cout << "Communication share: " << 100.0 * sum[1] / total << "%" << std::endl;
+    }
+}
+
+std::vector<double> PICA_Hybrid::get_best_solution() const
+{
+    return island->get_best_solution();
+}
+
+double PICA_Hybrid::get_best_fitness() const
+{
+    return island->get_best_fitness();
+}
+
+long long PICA_Hybrid::get_evaluations_saved() const
+{
+    return island->get_evaluations_saved();
+}
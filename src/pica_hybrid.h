@@ -0,0 +1,84 @@
+#ifndef PICA_HYBRID_H
+#define PICA_HYBRID_H
+
+#include "pica_ms.h"
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Seconds one rank spent running its island and exchanging elites
+struct Hybrid_Timing {
+    double compute;
+    double communication;
+};
+
+// MPI islands of PICA_MS thread teams. Every rank runs a multithreaded island
+// and the islands pass their elites around a ring every iterations_per_cycle
+// iterations, the way PICA_MP does with single-threaded islands. MPI is only
+// called by the main thread between team runs, so MPI_THREAD_FUNNELED is enough;
+// the constructors throw std::runtime_error when MPI provides less.
+class PICA_Hybrid
+{
+private:
+    int rank;
+    int size;
+    int local_rank;                 // position among the ranks sharing this node
+    int migration_cycles;
+    int iterations_per_cycle;
+    int dim;
+    int threads_per_rank;
+
+    std::unique_ptr<PICA_MS> island;
+    Hybrid_Timing timing;
+
+    void initialize(bool pin_threads);
+
+public:
+    // threads_per_rank sets the team size of each island, the number of
+    // islands is the number of ranks. With pin_threads the ranks on one node
+    // take consecutive, disjoint blocks of cores, see PICA_MS::enable_numa.
+    PICA_Hybrid(int pop_size, int dim, int max_iter,
+        double beta, double gamma, double eta,
+        double lb, double ub,
+        const std::function<double(const std::vector<double>&)>& obj_func,
+        int migration_cycles, int iterations_per_cycle,
+        int threads_per_rank, bool pin_threads = false,
+        unsigned long long seed = random_seed());
+    PICA_Hybrid(int pop_size, int dim, int max_iter,
+        double beta, double gamma, double eta,
+        double lb, double ub,
+        const Batch_Objective_Function& batch_obj_func,
+        int migration_cycles, int iterations_per_cycle,
+        int threads_per_rank, bool pin_threads = false,
+        unsigned long long seed = random_seed());
+
+    // Objective type resolved at compile time, see make_static_batch_objective
+    template<class Objective, class = std::enable_if_t<is_single_objective_v<Objective>>>
+    PICA_Hybrid(int pop_size, int dim, int max_iter,
+        double beta, double gamma, double eta,
+        double lb, double ub,
+        Objective objective,
+        int migration_cycles, int iterations_per_cycle,
+        int threads_per_rank, bool pin_threads = false,
+        unsigned long long seed = random_seed())
+        : PICA_Hybrid(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, make_static_batch_objective(objective),
+            migration_cycles, iterations_per_cycle, threads_per_rank, pin_threads, seed)
+    {}
+
+    void run();
+
+    // Time split of this rank, and the spread over all ranks printed by rank 0
+    Hybrid_Timing get_timing() const;
+    void report_timing();
+
+    int get_rank() const { return rank; }
+    int get_size() const { return size; }
+    int get_local_rank() const { return local_rank; }
+    int get_threads_per_rank() const { return threads_per_rank; }
+
+    std::vector<double> get_best_solution() const;
+    double get_best_fitness() const;
+    long long get_evaluations_saved() const;
+};
+
+#endif
@@ -1,102 +1,92 @@
 #include "pica_mp.h"
+#include "history_codec.h"
 #include <mpi.h>
 #include <iostream>
 #include <cassert>
+#include <algorithm>
+#include <cmath>
 
 PICA_MP::PICA_MP(int pop_size, int dim, int max_iter,
     double beta, double gamma, double eta,
     double lb, double ub,
     const std::function<double(const std::vector<double>&)>& obj_func,
     int migration_cycles, int iterations_per_cycle,
-    bool visual)
+    bool visual,
+    unsigned long long seed)
     : dim(dim), migration_cycles(migration_cycles), iterations_per_cycle(iterations_per_cycle)
 {
     this->obj_func = obj_func;
 
-    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    MPI_Comm_size(MPI_COMM_WORLD, &size);
     if(visual)
-        this->ica = new Visual_ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func);
+        this->ica = new Visual_ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func, seed);
     else
-        this->ica = new ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func);
-    this->ica->setup();
+        this->ica = new ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func, seed);
+    initialize(seed);
 }
 
-void PICA_MP::serialize_history(std::vector<double>& buffer)
+PICA_MP::PICA_MP(int pop_size, int dim, int max_iter,
+    double beta, double gamma, double eta,
+    double lb, double ub,
+    const Batch_Objective_Function& batch_obj_func,
+    int migration_cycles, int iterations_per_cycle,
+    bool visual,
+    unsigned long long seed)
+    : dim(dim), migration_cycles(migration_cycles), iterations_per_cycle(iterations_per_cycle)
 {
-    auto* visual_ica = static_cast<Visual_ICA*>(ica);
-    const auto& history = visual_ica->get_history();
-    buffer.clear();
-    buffer.push_back(static_cast<double>(history.size())); // Number of snapshots
-
-    for (const auto& snapshot : history)
-    {
-        const std::string& phase_name = snapshot.first;
-        const std::vector<Visual_Country_Snapshot>& countries = snapshot.second;
-
-        buffer.push_back(static_cast<double>(phase_name.length()));
-        for (char c : phase_name)
-            buffer.push_back(static_cast<double>(c));
-
-        buffer.push_back(static_cast<double>(countries.size()));
-        for (const auto& country : countries)
-        {
-            buffer.push_back(static_cast<double>(country.position.size()));
-            for (double pos : country.position)
-                buffer.push_back(pos);
-
-            buffer.push_back(country.is_emperor ? 1.0 : 0.0);
+    this->obj_func = make_single_objective(batch_obj_func);
 
-            buffer.push_back(country.colour[0]);
-            buffer.push_back(country.colour[1]);
-            buffer.push_back(country.colour[2]);
-        }
-    }
+    if(visual)
+        this->ica = new Visual_ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, batch_obj_func, seed);
+    else
+        this->ica = new ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, batch_obj_func, seed);
+    initialize(seed);
 }
 
-std::vector<std::pair<std::string, std::vector<Visual_Country_Snapshot>>> PICA_MP::deserialize_history(const std::vector<double>& buffer, int count)
+void PICA_MP::initialize(unsigned long long seed)
 {
-    std::vector<std::pair<std::string, std::vector<Visual_Country_Snapshot>>> history;
-    size_t idx = 0;
-    int num_snapshots = static_cast<int>(buffer[idx++]);
-
-    for (int snap = 0; snap < num_snapshots; ++snap)
-    {
-        int name_length = static_cast<int>(buffer[idx++]);
-        std::string phase_name;
-        for (int i = 0; i < name_length; ++i)
-            phase_name += static_cast<char>(buffer[idx++]);
-
-        int num_countries = static_cast<int>(buffer[idx++]);
-        std::vector<Visual_Country_Snapshot> countries;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
 
-        for (int c = 0; c < num_countries; ++c)
-        {
-            Visual_Country_Snapshot country;
-            int dim = static_cast<int>(buffer[idx++]);
-            country.position.resize(dim);
-            for (int d = 0; d < dim; ++d)
-                country.position[d] = buffer[idx++];
+    // Every rank must draw the same random graphs, whatever seed it was given
+    topology = Migration_Topology::Ring;
+    topology_degree = 2;
+    topology_seed = seed;
+    elites_per_packet = 1;
+    float_history = false;
+    monitor_interval = 0;
+    global_best_fitness = INFINITY;
+    receive_policy = Receive_Policy::Replace_Worst;
+    MPI_Bcast(&topology_seed, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+
+    compute_time = 0;
+    wait_time = 0;
+
+    // Every rank is its own island with its own streams
+    this->ica->seed_streams(rank, 1);
+    this->ica->setup();
+}
 
-            country.is_emperor = (buffer[idx++] > 0.5);
+void PICA_MP::set_history_precision(bool float_positions)
+{
+    float_history = float_positions;
+}
 
-            country.colour.resize(3);
-            country.colour[0] = buffer[idx++];
-            country.colour[1] = buffer[idx++];
-            country.colour[2] = buffer[idx++];
+void PICA_MP::serialize_history(std::vector<unsigned char>& buffer)
+{
+    auto* visual_ica = static_cast<Visual_ICA*>(ica);
+    encode_history(visual_ica->history, dim, float_history, buffer);
+}
 
-            countries.push_back(std::move(country));
-        }
-        history.emplace_back(std::move(phase_name), std::move(countries));
-    }
-    return history;
+std::vector<std::pair<std::string, std::vector<Visual_Country_Snapshot>>> PICA_MP::deserialize_history(const unsigned char* buffer, int count)
+{
+    return decode_history(buffer, static_cast<size_t>(count));
 }
 
 std::vector<std::vector<std::pair<std::string, std::vector<Visual_Country_Snapshot>>>> PICA_MP::gather_visualization_history()
 {
-    std::vector<double> send_buffer;
+    std::vector<unsigned char> send_buffer;
     serialize_history(send_buffer);
-    int local_size = send_buffer.size();
+    int local_size = static_cast<int>(send_buffer.size());
 
     std::vector<int> all_sizes;
     if (rank == 0)
@@ -115,25 +105,18 @@ std::vector<std::vector<std::pair<std::string, std::vector<Visual_Country_Snapsh
         }
     }
 
-    std::vector<double> recv_buffer;
+    std::vector<unsigned char> recv_buffer;
     if (rank == 0)
         recv_buffer.resize(total_size);
 
-    MPI_Gatherv(send_buffer.data(), local_size, MPI_DOUBLE, recv_buffer.data(), all_sizes.data(), processes_buffer_indexes.data(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Gatherv(send_buffer.data(), local_size, MPI_BYTE, recv_buffer.data(), all_sizes.data(), processes_buffer_indexes.data(), MPI_BYTE, 0, MPI_COMM_WORLD);
     if (rank == 0)
     {
         std::vector<std::vector<std::pair<std::string, std::vector<Visual_Country_Snapshot>>>> all_histories;
 
+        // Each rank's slice is decoded where it landed
         for (int i = 0; i < size; ++i)
-        {
-            std::vector<double> processes_buffer(
-                recv_buffer.begin() + processes_buffer_indexes[i],
-                recv_buffer.begin() + processes_buffer_indexes[i] + all_sizes[i]
-            );
-
-            auto processes_history = deserialize_history(processes_buffer, all_sizes[i]);
-            all_histories.push_back(std::move(processes_history));
-        }
+            all_histories.push_back(deserialize_history(recv_buffer.data() + processes_buffer_indexes[i], all_sizes[i]));
         return all_histories;
     }
     return {};
@@ -152,71 +135,285 @@ void PICA_MP::print_results(double fitness, std::vector<double>& location)
     std::cout << "]" << std::endl;
 }
 
+namespace
+{
+    // One elite exchange over the migration graph, in flight while the island iterates
+    struct Migration_Exchange
+    {
+        MPI_Comm graph = MPI_COMM_NULL;
+        MPI_Request request = MPI_REQUEST_NULL;
+        std::vector<double> send;
+        std::vector<double> recv;
+        bool active = false;
+    };
+}
+
+static MPI_Comm create_migration_graph(const Migration_Neighbours& neighbours)
+{
+    MPI_Comm graph;
+    MPI_Dist_graph_create_adjacent(MPI_COMM_WORLD,
+        static_cast<int>(neighbours.sources.size()), neighbours.sources.data(), MPI_UNWEIGHTED,
+        static_cast<int>(neighbours.destinations.size()), neighbours.destinations.data(), MPI_UNWEIGHTED,
+        MPI_INFO_NULL, 0, &graph);
+    return graph;
+}
+
+void PICA_MP::set_topology(Migration_Topology topology, int degree)
+{
+    this->topology = topology;
+    topology_degree = degree;
+}
+
+void PICA_MP::set_migration(int elites, Receive_Policy policy)
+{
+    elites_per_packet = std::max(1, elites);
+    receive_policy = policy;
+}
+
 void PICA_MP::run()
 {
+    double run_start = MPI_Wtime();
+    progress.clear();
+
+    double start = MPI_Wtime();
     ica->run();
     ica->set_max_iter(iterations_per_cycle);
-    MPI_Barrier(MPI_COMM_WORLD);
-
-    for (int cycle = 0; cycle < migration_cycles; ++cycle) 
+    compute_time += MPI_Wtime() - start;
+    progress.emplace_back(MPI_Wtime() - run_start, ica->get_fitness());
+
+    // A fixed graph is built once, a random one for every cycle
+    bool dynamic = topology_is_dynamic(topology);
+    MPI_Comm fixed_graph = MPI_COMM_NULL;
+    if (!dynamic)
+        fixed_graph = create_migration_graph(migration_neighbours(topology, rank, size, topology_degree, topology_seed, 0));
+
+    // Packets hold elites_per_packet records of dim values and the fitness,
+    // so the receiver does not re-evaluate them
+    int packet = elites_per_packet * (dim + 1);
+    auto finish = [&](Migration_Exchange& exchange)
     {
-        int prev = (rank - 1 + size) % size;
-        int next = (rank + 1) % size;
-        int tag = 0;
+        if (!exchange.active)
+            return;
+        double waited = MPI_Wtime();
+        MPI_Wait(&exchange.request, MPI_STATUS_IGNORE);
+        wait_time += MPI_Wtime() - waited;
+
+        for (size_t first = 0; first < exchange.recv.size(); first += packet)
+            ica->receive_elites(exchange.recv.data() + first, elites_per_packet, receive_policy);
+        if (exchange.graph != fixed_graph)
+            MPI_Comm_free(&exchange.graph);
+        exchange.active = false;
+    };
+
+    // Two exchanges can be in flight: the elites of a cycle are folded in
+    // once they arrive, at the end of the next cycle at the latest
+    Migration_Exchange exchanges[2];
+    for (int cycle = 0; cycle < migration_cycles; ++cycle)
+    {
+        Migration_Exchange& current = exchanges[cycle % 2];
+        Migration_Exchange& previous = exchanges[(cycle + 1) % 2];
+
+        Migration_Neighbours neighbours = migration_neighbours(topology, rank, size, topology_degree, topology_seed, cycle);
+        current.graph = dynamic ? create_migration_graph(neighbours) : fixed_graph;
 
-        std::vector<double> send_solution = ica->get_best_solution();
-        std::vector<double> recv_solution(dim);
+        current.send = ica->pack_elites(elites_per_packet);
+        current.recv.resize(neighbours.sources.size() * packet);
+        MPI_Ineighbor_allgather(current.send.data(), packet, MPI_DOUBLE, current.recv.data(), packet, MPI_DOUBLE, current.graph, &current.request);
+        current.active = true;
 
-        for (int r = 0; r < size; ++r)
+        start = MPI_Wtime();
+        ica->run();
+        compute_time += MPI_Wtime() - start;
+        progress.emplace_back(MPI_Wtime() - run_start, ica->get_fitness());
+
+        if (monitor_interval > 0 && (cycle + 1) % monitor_interval == 0)
         {
-            MPI_Barrier(MPI_COMM_WORLD);
+            synchronize_best();
+            if (rank == 0)
+                std::cout << "Cycle " << cycle + 1 << ": global best fitness " << global_best_fitness << std::endl;
         }
 
-        int err = MPI_Sendrecv(send_solution.data(), dim, MPI_DOUBLE, next, tag, recv_solution.data(), dim, MPI_DOUBLE, prev, tag, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
-
-        ica->migrate_best(recv_solution, obj_func);
-        ica->run();
+        finish(previous);
+        int arrived = 0;
+        MPI_Test(&current.request, &arrived, MPI_STATUS_IGNORE);
+        if (arrived)
+            finish(current);
     }
 
-    std::vector<double> local_best = ica->get_best_solution();
-    double local_fitness = ica->get_fitness();
+    // Complete the exchange, the last elites are still placed
+    finish(exchanges[migration_cycles % 2]);
+    finish(exchanges[(migration_cycles + 1) % 2]);
+    if (fixed_graph != MPI_COMM_NULL)
+        MPI_Comm_free(&fixed_graph);
 
-    std::vector<double> all_best_solutions;
-    std::vector<double> all_fitnesses;
+    synchronize_best();
+}
 
-    if (rank == 0)
+std::vector<double> PICA_MP::get_best_solution() const 
+{
+    if (global_best_fitness <= ica->get_fitness())
+        return global_best_solution;
+    return ica->get_best_solution();
+}
+
+double PICA_MP::get_best_fitness() const 
+{
+    return std::min(global_best_fitness, ica->get_fitness());
+}
+
+std::vector<double> PICA_MP::get_island_best_solution() const
+{
+    return ica->get_best_solution();
+}
+
+double PICA_MP::get_island_best_fitness() const
+{
+    return ica->get_fitness();
+}
+
+long long PICA_MP::get_evaluations_saved() const 
+{
+    return ica->get_evaluations_saved();
+}
+
+void PICA_MP::run_asynchronous()
+{
+    double run_start = MPI_Wtime();
+    progress.clear();
+
+    // Board layout: one entry per source, a sequence number followed by the
+    // packet. Sequence 0 marks an entry nobody has written yet.
+    Migration_Neighbours neighbours = migration_neighbours(topology, rank, size, topology_degree, topology_seed, 0);
+    int packet = elites_per_packet * (dim + 1);
+    int entry = packet + 1;
+    int sources = static_cast<int>(neighbours.sources.size());
+
+    double* board;
+    MPI_Win win;
+    MPI_Win_allocate(static_cast<MPI_Aint>(sources) * entry * sizeof(double), sizeof(double), MPI_INFO_NULL, MPI_COMM_WORLD, &board, &win);
+    MPI_Win_lock(MPI_LOCK_EXCLUSIVE, rank, 0, win);
+    std::fill(board, board + static_cast<size_t>(sources) * entry, 0.0);
+    MPI_Win_unlock(rank, win);
+    // The only meeting point before the end, no board may be written before it is cleared
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    // Where this rank's entry sits on each destination's board
+    std::vector<MPI_Aint> displacements;
+    for (int destination : neighbours.destinations)
     {
-        all_best_solutions.resize(size * dim);
-        all_fitnesses.resize(size);
+        std::vector<int> theirs = migration_neighbours(topology, destination, size, topology_degree, topology_seed, 0).sources;
+        int index = static_cast<int>(std::lower_bound(theirs.begin(), theirs.end(), rank) - theirs.begin());
+        displacements.push_back(static_cast<MPI_Aint>(index) * entry);
     }
 
-    MPI_Gather(local_best.data(), dim, MPI_DOUBLE, all_best_solutions.data(), dim, MPI_DOUBLE, 0, MPI_COMM_WORLD);
-    MPI_Gather(&local_fitness, 1, MPI_DOUBLE, all_fitnesses.data(), 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    double start = MPI_Wtime();
+    ica->run();
+    ica->set_max_iter(iterations_per_cycle);
+    compute_time += MPI_Wtime() - start;
+    progress.emplace_back(MPI_Wtime() - run_start, ica->get_fitness());
+
+    std::vector<double> outgoing(entry);
+    std::vector<double> incoming(static_cast<size_t>(sources) * entry);
+    std::vector<double> last_seen(sources, 0);
+    double sequence = 0;
 
-    if (rank == 0) 
+    for (int cycle = 0; cycle < migration_cycles; ++cycle)
     {
-        int best_index = 0;
-        double best_fitness = all_fitnesses[0];
-        for (int i = 1; i < size; ++i) 
+        start = MPI_Wtime();
+
+        // Publish, the exclusive lock keeps a reader from seeing half an entry
+        std::vector<double> elites = ica->pack_elites(elites_per_packet);
+        outgoing[0] = ++sequence;
+        std::copy(elites.begin(), elites.end(), outgoing.begin() + 1);
+        for (size_t d = 0; d < neighbours.destinations.size(); ++d)
+        {
+            int destination = neighbours.destinations[d];
+            MPI_Win_lock(MPI_LOCK_EXCLUSIVE, destination, 0, win);
+            MPI_Put(outgoing.data(), entry, MPI_DOUBLE, destination, displacements[d], entry, MPI_DOUBLE, win);
+            MPI_Win_unlock(destination, win);
+        }
+
+        // Read whatever the neighbours have published so far
+        MPI_Win_lock(MPI_LOCK_EXCLUSIVE, rank, 0, win);
+        MPI_Get(incoming.data(), sources * entry, MPI_DOUBLE, rank, 0, sources * entry, MPI_DOUBLE, win);
+        MPI_Win_unlock(rank, win);
+        wait_time += MPI_Wtime() - start;
+
+        // Fold in the entries that changed since the last read, their fitness travels along
+        for (int s = 0; s < sources; ++s)
         {
-            if (all_fitnesses[i] < best_fitness) 
+            const double* source_entry = incoming.data() + static_cast<size_t>(s) * entry;
+            if (source_entry[0] > last_seen[s])
             {
-                best_fitness = all_fitnesses[i];
-                best_index = i;
+                ica->receive_elites(source_entry + 1, elites_per_packet, receive_policy);
+                last_seen[s] = source_entry[0];
             }
         }
 
-        std::vector<double> global_best(dim);
-        std::copy(all_best_solutions.begin() + best_index * dim, all_best_solutions.begin() + (best_index + 1) * dim, global_best.begin());
+        start = MPI_Wtime();
+        ica->run();
+        compute_time += MPI_Wtime() - start;
+        progress.emplace_back(MPI_Wtime() - run_start, ica->get_fitness());
     }
+
+    MPI_Win_free(&win);
+    synchronize_best();
 }
 
-std::vector<double> PICA_MP::get_best_solution() const 
+void PICA_MP::set_monitoring(int every_cycles)
 {
-    return ica->get_best_solution();
+    monitor_interval = every_cycles;
 }
 
-double PICA_MP::get_best_fitness() const 
+void PICA_MP::synchronize_best()
 {
-    return ica->get_fitness();
-}
\ No newline at end of file
+    // MINLOC on (fitness, rank) names the owner, ties go to the lower rank
+    struct
+    {
+        double fitness;
+        int rank;
+    } local = { ica->get_fitness(), rank }, winner;
+    MPI_Allreduce(&local, &winner, 1, MPI_DOUBLE_INT, MPI_MINLOC, MPI_COMM_WORLD);
+
+    // Only the winning vector travels, from its owner
+    global_best_solution = ica->get_best_solution();
+    global_best_solution.resize(dim);
+    MPI_Bcast(global_best_solution.data(), dim, MPI_DOUBLE, winner.rank, MPI_COMM_WORLD);
+    global_best_fitness = winner.fitness;
+}
+
+double PICA_MP::time_to_target(double target)
+{
+    int cycles = static_cast<int>(progress.size());
+    std::vector<double> times(cycles), fitnesses(cycles);
+    for (int i = 0; i < cycles; ++i)
+    {
+        times[i] = progress[i].first;
+        fitnesses[i] = progress[i].second;
+    }
+
+    // A cycle ends for the run when its slowest rank gets there
+    std::vector<double> latest(cycles), best(cycles);
+    MPI_Allreduce(times.data(), latest.data(), cycles, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(fitnesses.data(), best.data(), cycles, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+
+    for (int i = 0; i < cycles; ++i)
+        if (best[i] <= target)
+            return latest[i];
+    return -1;
+}
+
+double PICA_MP::get_compute_time() const
+{
+    return compute_time;
+}
+
+double PICA_MP::get_wait_time() const
+{
+    return wait_time;
+}
+
+double PICA_MP::get_cycles_time() const
+{
+    return progress.empty() ? 0.0 : progress.back().first;
+}
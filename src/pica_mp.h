@@ -3,6 +3,7 @@
 
 #include "ica.h"
 #include "visual_ica.h"
+#include "migration_topology.h"
 #include <functional>
 #include <vector>
 
@@ -15,25 +16,113 @@ private:
     int iterations_per_cycle;
     int dim;
 
+    // Seconds in island iterations and blocked on migration requests
+    double compute_time;
+    double wait_time;
+
+    // Migration graph, the seed is rank 0's so random graphs agree
+    Migration_Topology topology;
+    int topology_degree;
+    unsigned long long topology_seed;
+
+    // Each packet carries the island's elites_per_packet best countries
+    int elites_per_packet;
+    Receive_Policy receive_policy;
+
+    // Last result of synchronize_best, and how often run refreshes it
+    std::vector<double> global_best_solution;
+    double global_best_fitness;
+    int monitor_interval;
+
+    // Elapsed seconds and island best at the end of every cycle of run
+    std::vector<std::pair<double, double>> progress;
+
     ICA* ica;
     std::function<double(const std::vector<double>&)> obj_func;
 
-    void serialize_history(std::vector<double>& buffer);
-    std::vector<std::pair<std::string, std::vector<Visual_Country_Snapshot>>> deserialize_history(const std::vector<double>& buffer, int count);
+    // History goes over the wire in the compact format of history_codec.h
+    bool float_history;
+    void serialize_history(std::vector<unsigned char>& buffer);
+    std::vector<std::pair<std::string, std::vector<Visual_Country_Snapshot>>> deserialize_history(const unsigned char* buffer, int count);
     void print_results(double fitness, std::vector<double>& location);   
+    void initialize(unsigned long long seed);
 public:
     PICA_MP(int pop_size, int dim, int max_iter,
         double beta, double gamma, double eta,
         double lb, double ub,
         const std::function<double(const std::vector<double>&)>& obj_func,
         int migration_cycles, int iterations_per_cycle,
-        bool visual = false);
+        bool visual = false,
+        unsigned long long seed = random_seed());
+    PICA_MP(int pop_size, int dim, int max_iter,
+        double beta, double gamma, double eta,
+        double lb, double ub,
+        const Batch_Objective_Function& batch_obj_func,
+        int migration_cycles, int iterations_per_cycle,
+        bool visual = false,
+        unsigned long long seed = random_seed());
+
+    // Objective type resolved at compile time, see make_static_batch_objective
+    template<class Objective, class = std::enable_if_t<is_single_objective_v<Objective>>>
+    PICA_MP(int pop_size, int dim, int max_iter,
+        double beta, double gamma, double eta,
+        double lb, double ub,
+        Objective objective,
+        int migration_cycles, int iterations_per_cycle,
+        bool visual = false,
+        unsigned long long seed = random_seed())
+        : PICA_MP(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, make_static_batch_objective(objective),
+            migration_cycles, iterations_per_cycle, visual, seed)
+    {
+        obj_func = make_static_objective(objective);
+        ica->obj_func = obj_func;
+    }
+
+    // Which islands exchange elites, every rank must pick the same one.
+    // degree is only used by Random_Regular. Call before run.
+    void set_topology(Migration_Topology topology, int degree = 2);
+
+    // Send the best elites countries each cycle and place the received ones
+    // by policy. Every rank must pick the same count, no larger than any
+    // island's population. Call before run.
+    void set_migration(int elites, Receive_Policy policy);
     void run();
 
+    // Islands never wait for each other: each publishes its elites into its
+    // destinations' entries of an MPI_Win elite board with MPI_Put under
+    // passive-target locks, and folds in whatever its own board holds before
+    // every cycle. Ranks may run different iterations_per_cycle. Random
+    // topologies keep their first graph. Locking and copying count as wait time.
+    void run_asynchronous();
+
+    // Seconds from the start of run until the best over all ranks first
+    // reached target, checked at cycle ends, -1 if it never did. Collective.
+    double time_to_target(double target);
+
+    // Send history positions as float32 instead of float64, halving the bulk of the gather
+    void set_history_precision(bool float_positions);
     std::vector<std::vector<std::pair<std::string, std::vector<Visual_Country_Snapshot>>>> gather_visualization_history();
     
+    // Share the best solution of all islands with every rank: a MINLOC
+    // reduction on (fitness, rank) and one broadcast of the winning vector,
+    // O(dim) traffic. Collective, run and run_asynchronous call it at the end.
+    void synchronize_best();
+
+    // Have run call synchronize_best every every_cycles cycles and rank 0
+    // print the result, 0 turns it off
+    void set_monitoring(int every_cycles);
+
+    // The better of the island's best and the last synchronized global best
     std::vector<double> get_best_solution() const;
     double get_best_fitness() const;
+    std::vector<double> get_island_best_solution() const;
+    double get_island_best_fitness() const;
+    long long get_evaluations_saved() const;
+    double get_compute_time() const;
+    double get_wait_time() const;
+    // Seconds from the start of the last run to the end of its last cycle,
+    // before the collectives that close the run
+    double get_cycles_time() const;
 
 };
 
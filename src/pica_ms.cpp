@@ -3,145 +3,224 @@
 #include <algorithm>
 #include <numeric>
 #include <cmath>
-#include <random>
+
+// Contiguous share of n items for thread tid out of threads
+static void thread_block(int n, int tid, int threads, int& start, int& count)
+{
+    int per_thread = n / threads;
+    int remainder = n % threads;
+    start = tid * per_thread + std::min(tid, remainder);
+    count = per_thread + (tid < remainder ? 1 : 0);
+}
+
+// Thread whose thread_block holds slot
+static int block_owner(int n, int threads, int slot)
+{
+    int per_thread = n / threads;
+    int remainder = n % threads;
+    int boundary = remainder * (per_thread + 1);
+    if (slot < boundary)
+        return slot / (per_thread + 1);
+    return remainder + (slot - boundary) / per_thread;
+}
 
 void PICA_MS::setup_parallel()
 {
-    int countries_per_thread = ica->pop_size / num_threads;
-    int remainder = ica->pop_size % num_threads;
-    #pragma omp parallel
+    ica->reserve_countries();
+    ica->population.assign(ica->pop_size, nullptr);
+
+    #pragma omp parallel num_threads(num_threads)
     {
+        Thread_Pin pin(worker_cpu());
         int tid = omp_get_thread_num();
-        int start = tid * countries_per_thread;
-        int count = countries_per_thread + (tid < remainder ? 1 : 0);
+        int start, count;
+        thread_block(ica->pop_size, tid, omp_get_num_threads(), start, count);
 
-        for (int i = 0; i < count; ++i)
+        if (numa_aware)
         {
-            std::vector<double> pos(ica->dim);
-            for (int j = 0; j < ica->dim; ++j)
-            {
-                double r = static_cast<double>(std::rand()) / (RAND_MAX + 1.0);
-                pos[j] = ica->lb + r * (ica->ub - ica->lb);
-            }
+            #pragma omp single
+            ica->store.reallocate_positions();
+            // The pages of each block land on the node of the thread owning it
+            ica->store.clear_rows(start, count);
+        }
 
-            // this could be made better
-            #pragma omp critical
-            {
-                ica->population.push_back(new Country(pos));
-            }
+        // Each thread fills its own block of rows in the store from its own stream
+        RNG& gen = ica->rng(tid);
+        for (int i = start; i < start + count; ++i)
+        {
+            gen.fill_uniform(ica->store.row(i), ica->dim, ica->lb, ica->ub);
+            ica->population[i] = ica->create_country(i);
         }
     }
+
+    ica->form_empires();
 }
 
 void PICA_MS::run_parallel()
 {
-    for (int iter = 0; iter < ica->max_iter; ++iter) 
-    {
-        calculate_fitness_parallel();
-        #pragma omp for
-        for (size_t i = 0; i < ica->empires.size(); ++i)
-        {
-            ica->assimilation_of_empire(i);
-            ica->revolution_of_empire(i);
-        }
-        mutiny_parallel();
-        ica->imperial_war();
-
-        if (ica->empires.size() == 1)
-            break;
-    }
+    run_team(false);
 }
 
 void PICA_MS::run_parallel_visual()
 {
-    for (int iter = 0; iter < ica->max_iter; ++iter)
-    {
-        calculate_fitness_parallel();
+    run_team(true);
+}
 
-        #pragma omp for
-        for (size_t i = 0; i < ica->empires.size(); ++i)
+void PICA_MS::run_team(bool record_history)
+{
+    // One team for the whole run, phases are separated by barriers
+    #pragma omp parallel num_threads(num_threads)
+    {
+        Thread_Pin pin(worker_cpu());
+        for (int iter = 0; iter < ica->max_iter; ++iter)
         {
-            ica->assimilation_of_empire(i);
+            calculate_fitness_parallel();
+
+            if (record_history)
+            {
+                scheduled_phase(true, false);
+                state_snapshot_parallel("Assimilation");
+
+                scheduled_phase(false, true);
+                state_snapshot_parallel("Revolution");
+            }
+            else
+            {
+                scheduled_phase(true, true);
+            }
+
+            mutiny_parallel();
+            if (record_history)
+                state_snapshot_parallel("Mutiny");
+
+            #pragma omp single
+            ica->imperial_war();
+            if (record_history)
+                state_snapshot_parallel("Imperial War");
+
+            // Every thread reads the same count after the barrier above
+            if (ica->empires.size() == 1)
+                break;
         }
-        state_snapshot_parallel("Assimilation");
+    }
+}
 
-        #pragma omp for
-        for (size_t i = 0; i < ica->empires.size(); ++i)
+void PICA_MS::scheduled_phase(bool assimilate, bool revolve)
+{
+    #pragma omp single
+    {
+        std::vector<int> sizes(ica->empires.size());
+        int total = 0;
+        for (size_t i = 0; i < sizes.size(); ++i)
         {
-            ica->revolution_of_empire(i);
+            sizes[i] = static_cast<int>(ica->empires[i]->vassals.size());
+            total += sizes[i];
         }
-        state_snapshot_parallel("Revolution");
+        int workers = omp_get_num_threads();
+        int chunk = Task_Scheduler::chunk_size(total, workers);
+        if (numa_aware)
+            scheduler.distribute(sizes, workers, chunk, [&](const Vassal_Task& task) { return home_node(task, workers); });
+        else
+            scheduler.distribute(sizes, workers, chunk);
+        ++task_epoch;
+    }
 
-        mutiny_parallel();
-        state_snapshot_parallel("Mutiny");
+    // The draws belong to the chunk, not to the thread that happens to run it
+    int tid = omp_get_thread_num();
+    Vassal_Task task;
+    while (scheduler.next(tid, task))
+    {
+        RNG gen = ica->task_rng(task_epoch, task.empire, task.chunk);
+        if (assimilate)
+            ica->assimilation_of_vassals(task.empire, task.first, task.count, gen);
+        if (revolve)
+            ica->revolution_of_vassals(task.empire, task.first, task.count, gen);
+    }
+    #pragma omp barrier
+}
 
-        ica->imperial_war(); 
-        state_snapshot_parallel("Imperial War");
+int PICA_MS::worker_cpu()
+{
+    return numa_aware ? topology.cpu_for(first_worker + omp_get_thread_num()) : -1;
+}
 
-        if (ica->empires.size() == 1)
-            break;
-    }
+int PICA_MS::home_node(const Vassal_Task& task, int threads)
+{
+    // The node whose threads own most of the chunk's rows
+    const auto& vassals = ica->empires[task.empire]->vassals;
+    node_votes.assign(topology.node_count, 0);
+    for (int j = task.first; j < task.first + task.count; ++j)
+        ++node_votes[topology.node_for(first_worker + block_owner(ica->store.size, threads, vassals[j]->slot))];
+    return static_cast<int>(std::max_element(node_votes.begin(), node_votes.end()) - node_votes.begin());
 }
 
 void PICA_MS::state_snapshot_parallel(std::string phase_name)
 {
     auto visual_ica = static_cast<Visual_ICA*>(ica);
-    std::vector<Visual_Country_Snapshot> step;
-    #pragma omp parallel
-    {
-        std::vector<Visual_Country_Snapshot> local_step;
 
-        #pragma omp for
-        for (auto* c : visual_ica->population)
-        {
-            Visual_Country_Snapshot country_snapshot;
-            country_snapshot.position = c->location;
-            country_snapshot.is_emperor = (c->vassal_of_empire == nullptr);
+    #pragma omp single
+    snapshot_step.assign(visual_ica->population.size(), Visual_Country_Snapshot());
 
-            auto vc = static_cast<Visual_Country*>(c);
-            country_snapshot.colour = vc->get_colour();
-
-            local_step.push_back(std::move(country_snapshot));
-        }
+    // Every thread fills its share in place, so the order matches the population
+    #pragma omp for schedule(static)
+    for (size_t i = 0; i < visual_ica->population.size(); ++i)
+    {
+        Country* c = visual_ica->population[i];
+        Visual_Country_Snapshot& country_snapshot = snapshot_step[i];
+        country_snapshot.position = c->location;
+        country_snapshot.is_emperor = (c->vassal_of_empire == nullptr);
 
-        #pragma omp critical
-        {
-            step.insert(step.end(),
-                std::make_move_iterator(local_step.begin()),
-                std::make_move_iterator(local_step.end()));
-        }
+        auto vc = static_cast<Visual_Country*>(c);
+        country_snapshot.colour = vc->get_colour();
     }
-    visual_ica->history.emplace_back(phase_name, std::move(step));
-}
 
+    #pragma omp single
+    visual_ica->history.emplace_back(phase_name, std::move(snapshot_step));
+}
 
 void PICA_MS::mutiny_parallel()
 {
-    std::vector<std::vector<Mutiny_Action>> thread_buffers(num_threads);
+    #pragma omp single
+    {
+        ica->empire_index.build(ica->empires, ica->dim, ica->kernels);
+        thread_buffers.resize(omp_get_num_threads());
+        mutiny_rows.clear();
+        for (auto* empire : ica->empires)
+            for (auto* vassal : empire->vassals)
+                mutiny_rows.push_back(vassal->slot);
+        mutiny_nearest.resize(mutiny_rows.size());
+        nearest_of_slot.assign(ica->store.size, -1);
+    }
 
-    #pragma omp for
-    for (size_t i = 1; i < ica->empires.size(); ++i)
+    // Nearest emperor for every vassal, one blocked batch per chunk of rows
+    const int chunk = 256;
+    int chunks = (static_cast<int>(mutiny_rows.size()) + chunk - 1) / chunk;
+    #pragma omp for schedule(dynamic)
+    for (int c = 0; c < chunks; ++c)
     {
-        int tid = omp_get_thread_num();
-        std::vector<Mutiny_Action>& local_buffer = thread_buffers[tid];
+        int first = c * chunk;
+        int count = std::min(chunk, static_cast<int>(mutiny_rows.size()) - first);
+        ica->empire_index.nearest_batch(ica->store, mutiny_rows.data() + first, count, mutiny_nearest.data() + first);
+        for (int r = first; r < first + count; ++r)
+            nearest_of_slot[mutiny_rows[r]] = mutiny_nearest[r];
+    }
+
+    int tid = omp_get_thread_num();
+    std::vector<Mutiny_Action>& local_buffer = thread_buffers[tid].actions;
+    local_buffer.clear();
 
+    #pragma omp for schedule(static)
+    for (size_t i = 0; i < ica->empires.size(); ++i)
+    {
         auto* empire = ica->empires[i];
-        for (size_t j = 1; j < empire->vassals.size(); ++j)
+        for (size_t j = 0; j < empire->vassals.size(); ++j)
         {
             auto* vassal = empire->vassals[j];
             Mutiny_Action temp;
             temp.colony = vassal;
-            auto* nearest_imperialist = *std::min_element(ica->empires.begin(), ica->empires.end(), [&](Country* a, Country* b)
-                {
-                    double country_a = 0;
-                    double country_b = 0;
-                    for (size_t k = 0; k < ica->dim; ++k)
-                    {
-                        country_a += std::pow(a->location[k] - vassal->location[k], 2);
-                        country_b += std::pow(b->location[k] - vassal->location[k], 2);
-                    }
-                    return country_a < country_b;
-                });
+            temp.source_idx = static_cast<int>(i);
+            temp.empire_idx = nearest_of_slot[vassal->slot];
+            auto* nearest_imperialist = ica->empires[temp.empire_idx];
             if (vassal->vassal_of_empire != nearest_imperialist)
                 temp.new_empire = nearest_imperialist;
             else
@@ -155,50 +234,154 @@ void PICA_MS::mutiny_parallel()
         }
     }
 
-    std::vector<Mutiny_Action> mutiny_buffer;
-    for (auto& buf : thread_buffers)
-        mutiny_buffer.insert(mutiny_buffer.end(), buf.begin(), buf.end());
+    // Every colony with an action leaves its empire. Grouped by source empire,
+    // each vassal list is touched by exactly one thread. The colony drops its
+    // empire id too, so the joins below never read the emperor slot of an
+    // empire another thread may be handing to a new emperor.
+    partition_actions(false);
+    #pragma omp for schedule(dynamic)
+    for (size_t e = 0; e < ica->empires.size(); ++e)
+    {
+        for (int k = empire_offsets[e]; k < empire_offsets[e + 1]; ++k)
+        {
+            Country* colony = sorted_actions[k].colony;
+            ica->empires[e]->remove_vassal(colony);
+            colony->vassal_of_empire = nullptr;
+        }
+    }
 
-    for (auto& action : mutiny_buffer)
+    // Then joins its target, grouped by target empire. When several colonies
+    // overthrow the same emperor the fittest wins, ties to the lower slot, and
+    // the others join the empire under it.
+    partition_actions(true);
+    #pragma omp for schedule(dynamic)
+    for (size_t e = 0; e < ica->empires.size(); ++e)
     {
-        #pragma omp critical
+        Country* emperor = ica->empires[e];
+        Country* winner = nullptr;
+        for (int k = empire_offsets[e]; k < empire_offsets[e + 1]; ++k)
         {
-            auto& vassals = action.colony->vassal_of_empire->vassals;
-            vassals.erase(std::remove(vassals.begin(), vassals.end(), action.colony), vassals.end());
+            const Mutiny_Action& action = sorted_actions[k];
+            if (action.empire_swap && (winner == nullptr || action.colony->fitness < winner->fitness
+                || (action.colony->fitness == winner->fitness && action.colony->slot < winner->slot)))
+                winner = action.colony;
+        }
 
-            if (action.empire_swap)
-            {
-                action.colony->coup(action.new_empire);
+        for (int k = empire_offsets[e]; k < empire_offsets[e + 1]; ++k)
+        {
+            Country* colony = sorted_actions[k].colony;
+            if (colony == winner)
+                continue;
+            emperor->add_vassal(colony);
+            colony->add_emperor(emperor);
+        }
 
-                auto emp_idx = std::find(ica->empires.begin(), ica->empires.end(), action.new_empire);
-                if (emp_idx != ica->empires.end())
-                    *emp_idx = action.colony;
+        if (winner)
+        {
+            winner->coup(emperor);
+            ica->empires[e] = winner;
+        }
+    }
+}
 
-                auto col_idx = std::find(action.new_empire->vassals.begin(), action.new_empire->vassals.end(), action.colony);
-                if (col_idx != action.new_empire->vassals.end())
-                    *col_idx = action.new_empire;
-            }
-            else
+void PICA_MS::partition_actions(bool by_target)
+{
+    // Parallel counting sort of the actions by empire, stable in thread order
+    int tid = omp_get_thread_num();
+    int empire_count = static_cast<int>(ica->empires.size());
+    Action_Buffer& mine = thread_buffers[tid];
+
+    mine.offsets.assign(empire_count, 0);
+    for (const Mutiny_Action& action : mine.actions)
+        ++mine.offsets[by_target ? action.empire_idx : action.source_idx];
+    #pragma omp barrier
+
+    #pragma omp single
+    {
+        int running = 0;
+        empire_offsets.assign(empire_count + 1, 0);
+        for (int e = 0; e < empire_count; ++e)
+        {
+            empire_offsets[e] = running;
+            for (auto& buffer : thread_buffers)
             {
-                action.new_empire->add_vassal(action.colony);
-                action.colony->add_emperor(action.new_empire);
+                int count = buffer.offsets[e];
+                buffer.offsets[e] = running;
+                running += count;
             }
         }
+        empire_offsets[empire_count] = running;
+        sorted_actions.resize(running);
     }
+
+    for (const Mutiny_Action& action : mine.actions)
+        sorted_actions[mine.offsets[by_target ? action.empire_idx : action.source_idx]++] = action;
+    #pragma omp barrier
 }
 
 void PICA_MS::calculate_fitness_parallel()
 {
-    #pragma omp for
-    for (auto& c : ica->population)
+    Population_Store& store = ica->store;
+    int tid = omp_get_thread_num();
+    int threads = omp_get_num_threads();
+
+    #pragma omp single
+    thread_best.resize(threads);
+
+    // One batch call per thread over the dirty rows of its block, then the
+    // best of the block
+    int start, count;
+    thread_block(store.size, tid, threads, start, count);
+    Thread_Best& local = thread_best[tid];
+    local.changed.clear();
+    local.evaluated = ica->evaluate_dirty(start, start + count, batch_obj_func, local.changed);
+    local.fitness = INFINITY;
+    local.slot = -1;
+    for (int slot = start; slot < start + count; ++slot)
     {
-        c->evaluate_fitness(obj_func);
-        if (c->fitness < ica->best_fitness)
+        if (store.fitness[slot] < local.fitness)
         {
-            ica->best_fitness = c->fitness;
-            ica->best_solution = c->location;
+            local.fitness = store.fitness[slot];
+            local.slot = slot;
         }
     }
+    #pragma omp barrier
+
+    #pragma omp single
+    {
+        int evaluated = 0;
+        int best_slot = -1;
+        double best = INFINITY;
+        for (const Thread_Best& t : thread_best)
+        {
+            evaluated += t.evaluated;
+            if (t.slot >= 0 && t.fitness < best)
+            {
+                best = t.fitness;
+                best_slot = t.slot;
+            }
+        }
+        ica->evaluations += evaluated;
+        ica->evaluations_saved += store.size - evaluated;
+        if (best_slot >= 0)
+            ica->update_best(best_slot, best_slot + 1);
+    }
+
+    // Only the re-evaluated vassals touch the aggregates. Empire ids are dealt
+    // round robin, so every empire is updated by one thread without locks.
+    for (const Thread_Best& t : thread_best)
+    {
+        for (const Fitness_Change& change : t.changed)
+        {
+            Country* country = store.countries[change.slot];
+            int id = store.empire_id[change.slot];
+            if (id < 0 || id % threads != tid)
+                continue;
+            if (Country* emperor = country->vassal_of_empire)
+                emperor->vassal_fitness_changed(country, change.old_fitness);
+        }
+    }
+    #pragma omp barrier
 }
 
 PICA_MS::PICA_MS(
@@ -212,12 +395,111 @@ PICA_MS::PICA_MS(
     double ub,
     const std::function<double(const std::vector<double>&)>& obj_func,
     bool visual,
-    int num_threads
-) : num_threads(num_threads), obj_func(obj_func), visual(visual)
+    int num_threads,
+    unsigned long long seed
+) : obj_func(obj_func), batch_obj_func(make_batch_objective(obj_func)), num_threads(num_threads), visual(visual), task_epoch(0), numa_aware(false), first_worker(0)
+{
+    if(visual)
+        ica = new Visual_ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func, seed);
+    else
+        ica = new ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func, seed);
+    ica->seed_streams(0, num_threads);
+    omp_set_num_threads(num_threads);
+}
+
+PICA_MS::PICA_MS(
+    int pop_size,
+    int dim,
+    int max_iter,
+    double beta,
+    double gamma,
+    double eta,
+    double lb,
+    double ub,
+    const Batch_Objective_Function& batch_obj_func,
+    bool visual,
+    int num_threads,
+    unsigned long long seed
+) : obj_func(make_single_objective(batch_obj_func)), batch_obj_func(batch_obj_func), num_threads(num_threads), visual(visual), task_epoch(0), numa_aware(false), first_worker(0)
 {
     if(visual)
-        ica = new Visual_ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func);
+        ica = new Visual_ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, batch_obj_func, seed);
     else
-        ica = new ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func);
+        ica = new ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, batch_obj_func, seed);
+    ica->seed_streams(0, num_threads);
     omp_set_num_threads(num_threads);
-}
\ No newline at end of file
+}
+
+void PICA_MS::set_island(int island)
+{
+    ica->seed_streams(island, num_threads);
+}
+
+void PICA_MS::set_max_iter(int max_iter)
+{
+    ica->set_max_iter(max_iter);
+}
+
+void PICA_MS::migrate_best(const std::vector<double>& elite_solution, double elite_fitness)
+{
+    ica->migrate_best(elite_solution, elite_fitness);
+}
+
+std::vector<double> PICA_MS::get_best_solution() const
+{
+    return ica->get_best_solution();
+}
+
+double PICA_MS::get_best_fitness() const
+{
+    return ica->get_fitness();
+}
+
+const std::vector<Country*>& PICA_MS::get_empires() const
+{
+    return ica->empires;
+}
+
+void PICA_MS::enable_numa(int first_worker)
+{
+    numa_aware = true;
+    this->first_worker = first_worker;
+    topology = Numa_Topology::detect();
+
+    std::vector<int> nodes(num_threads);
+    for (int tid = 0; tid < num_threads; ++tid)
+        nodes[tid] = topology.node_for(first_worker + tid);
+    scheduler.set_worker_nodes(nodes);
+}
+
+Numa_Placement PICA_MS::get_numa_placement() const
+{
+    Numa_Topology nodes = numa_aware ? topology : Numa_Topology::detect();
+    const Population_Store& store = ica->store;
+
+    Numa_Placement placement;
+    placement.pages = nodes.pages_per_node(store.positions, static_cast<size_t>(store.size) * store.stride * sizeof(double));
+    placement.rows.assign(nodes.node_count, 0);
+    for (int tid = 0; tid < num_threads; ++tid)
+    {
+        int start, count;
+        thread_block(store.size, tid, num_threads, start, count);
+        placement.rows[nodes.node_for(first_worker + tid)] += count;
+    }
+    return placement;
+}
+
+long long PICA_MS::get_evaluations_saved() const
+{
+    return ica->get_evaluations_saved();
+}
+
+void PICA_MS::enable_evaluation_cache(double tolerance, size_t capacity)
+{
+    ica->enable_evaluation_cache(tolerance, capacity);
+}
+
+const Evaluation_Cache* PICA_MS::get_evaluation_cache() const
+{
+    return ica->evaluation_cache.get();
+}
@@ -3,6 +3,8 @@
 
 #include "ica.h"
 #include "visual_ica.h"
+#include "task_scheduler.h"
+#include "numa_topology.h"
 #include <omp.h>
 #include <functional>
 #include <vector>
@@ -10,21 +12,75 @@
 struct Mutiny_Action {
     Country* colony;               
     Country* new_empire;      
+    int source_idx;                // position of the colony's current empire
+    int empire_idx;                // position of new_empire in the empires list
     bool empire_swap;     
 };
 
+// Where the position matrix lives next to the rows each node's threads own,
+// the two match when the blocks were first touched by their owners
+struct Numa_Placement {
+    std::vector<long long> pages;  // resident pages per node, empty when unknown
+    std::vector<long long> rows;   // rows owned by the threads of each node
+};
+
 class PICA_MS
 {
 private:
+    // Best of one thread's block, padded so threads do not share a cache line
+    struct alignas(64) Thread_Best
+    {
+        double fitness;
+        int slot;
+        int evaluated;
+        std::vector<Fitness_Change> changed;
+    };
+
     ICA* ica;
     std::function<double(const std::vector<double>&)> obj_func;
+    Batch_Objective_Function batch_obj_func;
     int num_threads;
     bool visual;
 
+    // Chunks of empire vassals for assimilation and revolution, epoch counts
+    // the scheduled phases so every chunk draws from its own stream
+    Task_Scheduler scheduler;
+    unsigned long long task_epoch;
+
+    // Pinned threads, first-touched blocks and node-local chunks, see enable_numa
+    bool numa_aware;
+    int first_worker;               // topology position of thread 0
+    Numa_Topology topology;
+    std::vector<int> node_votes;
+
+    // Shared scratch of the thread team
+    std::vector<Thread_Best> thread_best;
+    // Mutiny actions of one thread and its per-empire counts for the
+    // partitioning, padded so neighbouring threads do not share a cache line
+    struct alignas(64) Action_Buffer
+    {
+        std::vector<Mutiny_Action> actions;
+        std::vector<int> offsets;
+    };
+
+    std::vector<Action_Buffer> thread_buffers;
+    std::vector<Mutiny_Action> sorted_actions;
+    std::vector<int> empire_offsets;
+    std::vector<int> mutiny_rows;
+    std::vector<int> mutiny_nearest;
+    std::vector<int> nearest_of_slot;
+    std::vector<Visual_Country_Snapshot> snapshot_step;
+
+    // The phase helpers are called by every thread of the team in run_parallel
+    // and run_parallel_visual, they synchronize with barriers between phases
+    void run_team(bool record_history);
+    int worker_cpu();
+    int home_node(const Vassal_Task& task, int threads);
+    void scheduled_phase(bool assimilate, bool revolve);
     void mutiny_parallel();
+    void partition_actions(bool by_target);
     void calculate_fitness_parallel();
 
-
 public:
     PICA_MS(
         int pop_size,
@@ -37,13 +93,77 @@ public:
         double ub,
         const std::function<double(const std::vector<double>&)>& obj_func,
         bool visual,
-        int num_threads = 4
+        int num_threads = 4,
+        unsigned long long seed = random_seed()
+    );
+
+    PICA_MS(
+        int pop_size,
+        int dim,
+        int max_iter,
+        double beta,
+        double gamma,
+        double eta,
+        double lb,
+        double ub,
+        const Batch_Objective_Function& batch_obj_func,
+        bool visual,
+        int num_threads = 4,
+        unsigned long long seed = random_seed()
     );
 
+    // Objective type resolved at compile time, see make_static_batch_objective
+    template<class Objective, class = std::enable_if_t<is_single_objective_v<Objective>>>
+    PICA_MS(
+        int pop_size,
+        int dim,
+        int max_iter,
+        double beta,
+        double gamma,
+        double eta,
+        double lb,
+        double ub,
+        Objective objective,
+        bool visual,
+        int num_threads = 4,
+        unsigned long long seed = random_seed()
+    ) : PICA_MS(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, make_static_batch_objective(objective), visual, num_threads, seed)
+    {
+        obj_func = make_static_objective(objective);
+        ica->obj_func = obj_func;
+    }
+
+    // Island id for the random streams, for engines running side by side
+    // under MPI. Call before setup_parallel.
+    void set_island(int island);
+    void set_max_iter(int max_iter);
+    // Replace the worst country by an elite whose fitness is already known
+    void migrate_best(const std::vector<double>& elite_solution, double elite_fitness);
+
     void setup_parallel();
     void run_parallel();
     void run_parallel_visual();
     void state_snapshot_parallel(std::string phase_name);
+
+    std::vector<double> get_best_solution() const;
+    double get_best_fitness() const;
+    const std::vector<Country*>& get_empires() const;
+
+    // Pin each thread to a core, node by node, let every thread first touch
+    // the rows it owns and deal empire chunks to the node holding their rows.
+    // Thread t takes core first_worker + t, so engines sharing a machine can
+    // claim disjoint cores. Call before setup_parallel. Threads are pinned
+    // only inside setup_parallel and the runs, each gets its old CPUs back
+    // when they return.
+    void enable_numa(int first_worker = 0);
+    Numa_Placement get_numa_placement() const;
+
+    // Objective calls skipped because the country had not moved or was cached
+    long long get_evaluations_saved() const;
+
+    // Shared by all threads, see ICA::enable_evaluation_cache
+    void enable_evaluation_cache(double tolerance, size_t capacity);
+    const Evaluation_Cache* get_evaluation_cache() const;
     
     ~PICA_MS() = default;
 };
@@ -0,0 +1,139 @@
+#include "population_store.h"
+#include <algorithm>
+#include <new>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define ICA_MAP_POSITIONS
+#endif
+
+// Rows of at least 8 doubles are padded to whole 64-byte lines
+static const size_t ROW_ALIGNMENT = 64;
+
+Location_View::Location_View(double* row, int length)
+    : row(row), length(length)
+{}
+
+Location_View& Location_View::operator=(const Location_View& other)
+{
+    std::copy(other.begin(), other.end(), row);
+    return *this;
+}
+
+Location_View& Location_View::operator=(const std::vector<double>& values)
+{
+    if (values.size() != size())
+        throw std::invalid_argument("Location_View: assigned vector does not match the row length");
+    std::copy(values.begin(), values.end(), row);
+    return *this;
+}
+
+Location_View::operator std::vector<double>() const
+{
+    return std::vector<double>(begin(), end());
+}
+
+bool operator==(const Location_View& a, const std::vector<double>& b)
+{
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+bool operator==(const std::vector<double>& a, const Location_View& b)
+{
+    return b == a;
+}
+
+bool operator!=(const Location_View& a, const std::vector<double>& b)
+{
+    return !(a == b);
+}
+
+bool operator!=(const std::vector<double>& a, const Location_View& b)
+{
+    return !(b == a);
+}
+
+Population_Store::Population_Store(int size, int dim)
+    : size(size), dim(dim),
+    stride(dim < 8 ? dim : (dim + 7) / 8 * 8),
+    fitness(size, -std::numeric_limits<double>::infinity()),
+    empire_id(size, -1),
+    vassal_index(size, -1),
+    dirty(size, 1),
+    countries(size, nullptr),
+    mapped(false)
+{
+    positions = static_cast<double*>(::operator new(position_bytes(), std::align_val_t(ROW_ALIGNMENT)));
+    clear_rows(0, size);
+}
+
+Population_Store::~Population_Store()
+{
+    free_positions();
+}
+
+size_t Population_Store::position_bytes() const
+{
+    return std::max<size_t>(1, static_cast<size_t>(size) * stride) * sizeof(double);
+}
+
+void Population_Store::free_positions()
+{
+#ifdef ICA_MAP_POSITIONS
+    if (mapped)
+    {
+        munmap(positions, position_bytes());
+        return;
+    }
+#endif
+    ::operator delete(positions, std::align_val_t(ROW_ALIGNMENT));
+}
+
+void Population_Store::reallocate_positions()
+{
+#ifdef ICA_MAP_POSITIONS
+    // Fresh anonymous pages straight from the kernel: page aligned and not
+    // backed until first written, whatever the size of the population
+    void* fresh = mmap(nullptr, position_bytes(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (fresh == MAP_FAILED)
+        throw std::bad_alloc();
+    free_positions();
+    positions = static_cast<double*>(fresh);
+    mapped = true;
+#else
+    // Without mmap the heap may recycle pages that were already touched, so
+    // placement by first touch is only likely for large populations
+    double* fresh = static_cast<double*>(::operator new(position_bytes(), std::align_val_t(ROW_ALIGNMENT)));
+    free_positions();
+    positions = fresh;
+#endif
+}
+
+void Population_Store::clear_rows(int first, int count)
+{
+    std::fill(row(first), row(first) + static_cast<size_t>(count) * stride, 0.0);
+}
+
+int Population_Store::found_empire(int slot)
+{
+    int id = static_cast<int>(emperor_slot.size());
+    emperor_slot.push_back(slot);
+    empire_id[slot] = id;
+    return id;
+}
+
+bool Population_Store::is_emperor(int slot) const
+{
+    int id = empire_id[slot];
+    return id >= 0 && emperor_slot[id] == slot;
+}
+
+Country* Population_Store::emperor_of(int slot) const
+{
+    int id = empire_id[slot];
+    if (id < 0 || emperor_slot[id] == slot || emperor_slot[id] < 0)
+        return nullptr;
+    return countries[emperor_slot[id]];
+}
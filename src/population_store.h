@@ -0,0 +1,97 @@
+#ifndef POPULATION_STORE_H
+#define POPULATION_STORE_H
+
+#include <vector>
+#include <cstddef>
+
+class Country;
+
+// Non-owning view of one row of the position matrix.
+// Copying a view rebinds it, assigning through it copies coordinates into the row.
+class Location_View
+{
+    double* row;
+    int length;
+
+public:
+    Location_View(double* row, int length);
+    Location_View(const Location_View& other) = default;
+
+    Location_View& operator=(const Location_View& other);
+    // Throws std::invalid_argument unless values has exactly size() entries
+    Location_View& operator=(const std::vector<double>& values);
+    operator std::vector<double>() const;
+
+    size_t size() const { return static_cast<size_t>(length); }
+    double* data() { return row; }
+    const double* data() const { return row; }
+
+    double& operator[](size_t i) { return row[i]; }
+    const double& operator[](size_t i) const { return row[i]; }
+
+    double* begin() { return row; }
+    double* end() { return row + length; }
+    const double* begin() const { return row; }
+    const double* end() const { return row + length; }
+};
+
+bool operator==(const Location_View& a, const std::vector<double>& b);
+bool operator==(const std::vector<double>& a, const Location_View& b);
+bool operator!=(const Location_View& a, const std::vector<double>& b);
+bool operator!=(const std::vector<double>& a, const Location_View& b);
+
+// Contiguous storage for the whole population. Every country owns one slot:
+// a row of the aligned pop_size x stride position matrix and one entry in each
+// of the parallel arrays below. Country objects are thin views over a slot.
+class Population_Store
+{
+public:
+    int size;
+    int dim;
+    int stride;
+    double* positions;
+
+    std::vector<double> fitness;
+    std::vector<int> empire_id;
+    std::vector<int> vassal_index;
+    // Set when the position moved since its fitness was last evaluated
+    std::vector<char> dirty;
+
+    // empire id -> slot of its emperor, -1 once the empire has fallen
+    std::vector<int> emperor_slot;
+    // slot -> view registered for it
+    std::vector<Country*> countries;
+
+    Population_Store(int size, int dim);
+    Population_Store(const Population_Store&) = delete;
+    Population_Store& operator=(const Population_Store&) = delete;
+    ~Population_Store();
+
+    // Swap in freshly mapped, page-aligned positions no thread has written yet,
+    // so each page lands on the node of the thread that first clears it with
+    // clear_rows. Only valid before any country views the rows.
+    void reallocate_positions();
+
+    // Zero rows [first, first + count), padding included
+    void clear_rows(int first, int count);
+
+    double* row(int slot) { return positions + static_cast<size_t>(slot) * stride; }
+    const double* row(int slot) const { return positions + static_cast<size_t>(slot) * stride; }
+
+    // Make the country in slot the emperor of a new empire, returns its id
+    int found_empire(int slot);
+
+    bool is_emperor(int slot) const;
+
+    // Emperor of the empire slot belongs to, nullptr for emperors and unassigned slots
+    Country* emperor_of(int slot) const;
+
+private:
+    // Whether positions came from mmap rather than the heap
+    bool mapped;
+
+    size_t position_bytes() const;
+    void free_positions();
+};
+
+#endif
@@ -0,0 +1,100 @@
+#include "rng.h"
+#include <random>
+
+static const uint32_t PHILOX_M0 = 0xD2511F53u;
+static const uint32_t PHILOX_M1 = 0xCD9E8D57u;
+static const uint32_t PHILOX_W0 = 0x9E3779B9u;
+static const uint32_t PHILOX_W1 = 0xBB67AE85u;
+static const double TO_UNIT = 1.0 / 9007199254740992.0; // 2^-53
+
+uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+unsigned long long random_seed()
+{
+    std::random_device device;
+    return (static_cast<unsigned long long>(device()) << 32) ^ device();
+}
+
+RNG::RNG(unsigned long long seed, unsigned long long stream)
+    : counter(0), used(4)
+{
+    uint64_t k = splitmix64(splitmix64(seed) ^ stream);
+    key[0] = static_cast<uint32_t>(k);
+    key[1] = static_cast<uint32_t>(k >> 32);
+}
+
+void RNG::next_block()
+{
+    uint32_t c0 = static_cast<uint32_t>(counter);
+    uint32_t c1 = static_cast<uint32_t>(counter >> 32);
+    uint32_t c2 = 0, c3 = 0;
+    uint32_t k0 = key[0], k1 = key[1];
+
+    for (int round = 0; round < 10; ++round)
+    {
+        uint64_t p0 = static_cast<uint64_t>(PHILOX_M0) * c0;
+        uint64_t p1 = static_cast<uint64_t>(PHILOX_M1) * c2;
+        c0 = static_cast<uint32_t>(p1 >> 32) ^ c1 ^ k0;
+        c1 = static_cast<uint32_t>(p1);
+        c2 = static_cast<uint32_t>(p0 >> 32) ^ c3 ^ k1;
+        c3 = static_cast<uint32_t>(p0);
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    block[0] = c0;
+    block[1] = c1;
+    block[2] = c2;
+    block[3] = c3;
+    used = 0;
+    ++counter;
+}
+
+RNG::result_type RNG::operator()()
+{
+    if (used == 4)
+        next_block();
+    return block[used++];
+}
+
+uint64_t RNG::next_u64()
+{
+    uint64_t hi = (*this)();
+    return (hi << 32) | (*this)();
+}
+
+double RNG::uniform()
+{
+    return (next_u64() >> 11) * TO_UNIT;
+}
+
+double RNG::uniform(double lo, double hi)
+{
+    return lo + uniform() * (hi - lo);
+}
+
+void RNG::fill_uniform(double* out, size_t n, double lo, double hi)
+{
+    double scale = (hi - lo) * TO_UNIT;
+    size_t i = 0;
+
+    // Whole blocks give two values each
+    if (used == 4)
+    {
+        for (; i + 1 < n; i += 2)
+        {
+            next_block();
+            out[i] = lo + ((((static_cast<uint64_t>(block[0]) << 32) | block[1]) >> 11) * scale);
+            out[i + 1] = lo + ((((static_cast<uint64_t>(block[2]) << 32) | block[3]) >> 11) * scale);
+        }
+        used = 4;
+    }
+    for (; i < n; ++i)
+        out[i] = lo + (next_u64() >> 11) * scale;
+}
@@ -0,0 +1,47 @@
+#ifndef RNG_H
+#define RNG_H
+
+#include <cstdint>
+#include <cstddef>
+
+// Seed drawn from std::random_device, used when the caller does not pick one
+unsigned long long random_seed();
+
+// SplitMix64 finalizer, a bijective 64-bit mix for deriving keys and stream ids
+uint64_t splitmix64(uint64_t x);
+
+// Counter-based generator (Philox4x32-10). A stream is fully described by its
+// key, derived from the run seed and a stream id, and a block counter, so
+// streams for different threads or islands never share state or overlap.
+// Satisfies UniformRandomBitGenerator, so it can drive std::shuffle.
+class alignas(64) RNG
+{
+    uint32_t key[2];
+    uint64_t counter;
+    uint32_t block[4];
+    int used;
+
+    void next_block();
+
+public:
+    using result_type = uint32_t;
+
+    RNG(unsigned long long seed = 0, unsigned long long stream = 0);
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT32_MAX; }
+    result_type operator()();
+
+    uint64_t next_u64();
+
+    // Uniform in [0, 1)
+    double uniform();
+
+    // Uniform in [lo, hi)
+    double uniform(double lo, double hi);
+
+    // Fill n values uniform in [lo, hi)
+    void fill_uniform(double* out, size_t n, double lo = 0.0, double hi = 1.0);
+};
+
+#endif
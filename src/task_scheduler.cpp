@@ -0,0 +1,153 @@
+#include "task_scheduler.h"
+#include <algorithm>
+
+int Task_Scheduler::chunk_size(int total, int num_workers)
+{
+    const int MIN_CHUNK = 16;
+    const int CHUNKS_PER_WORKER = 8;
+    return std::max(MIN_CHUNK, total / std::max(1, num_workers * CHUNKS_PER_WORKER));
+}
+
+void Task_Scheduler::distribute(const std::vector<int>& empire_sizes, int num_workers, int chunk)
+{
+    reset(num_workers);
+
+    // Round robin, so every worker starts with a share of the large empires
+    int next_worker = 0;
+    for (int e = 0; e < static_cast<int>(empire_sizes.size()); ++e)
+    {
+        int c = 0;
+        for (int first = 0; first < empire_sizes[e]; first += chunk, ++c)
+        {
+            Vassal_Task task = { e, first, std::min(chunk, empire_sizes[e] - first), c };
+            workers[next_worker]->tasks.push_back(task);
+            next_worker = (next_worker + 1) % num_workers;
+        }
+    }
+    publish();
+}
+
+void Task_Scheduler::reset(int num_workers)
+{
+    while (static_cast<int>(workers.size()) < num_workers)
+        workers.emplace_back(new Worker_Deque());
+    for (auto& worker : workers)
+        worker->tasks.clear();
+}
+
+void Task_Scheduler::publish()
+{
+    for (auto& worker : workers)
+    {
+        worker->top.store(0, std::memory_order_relaxed);
+        worker->bottom.store(static_cast<long long>(worker->tasks.size()), std::memory_order_release);
+    }
+}
+
+void Task_Scheduler::set_worker_nodes(const std::vector<int>& nodes)
+{
+    worker_node = nodes;
+}
+
+int Task_Scheduler::node_of(int worker) const
+{
+    return worker < static_cast<int>(worker_node.size()) ? worker_node[worker] : 0;
+}
+
+void Task_Scheduler::distribute(const std::vector<int>& empire_sizes, int num_workers, int chunk,
+    const std::function<int(const Vassal_Task&)>& home_node)
+{
+    reset(num_workers);
+
+    // Workers of each node, a chunk whose node has none falls back to all
+    std::vector<std::vector<int>> node_workers;
+    for (int w = 0; w < num_workers; ++w)
+    {
+        int node = node_of(w);
+        if (node >= static_cast<int>(node_workers.size()))
+            node_workers.resize(node + 1);
+        node_workers[node].push_back(w);
+    }
+    std::vector<int> next_on_node(node_workers.size(), 0);
+    int next_worker = 0;
+
+    for (int e = 0; e < static_cast<int>(empire_sizes.size()); ++e)
+    {
+        int c = 0;
+        for (int first = 0; first < empire_sizes[e]; first += chunk, ++c)
+        {
+            Vassal_Task task = { e, first, std::min(chunk, empire_sizes[e] - first), c };
+            int node = home_node(task);
+            int worker;
+            if (node >= 0 && node < static_cast<int>(node_workers.size()) && !node_workers[node].empty())
+            {
+                worker = node_workers[node][next_on_node[node]];
+                next_on_node[node] = (next_on_node[node] + 1) % node_workers[node].size();
+            }
+            else
+            {
+                worker = next_worker;
+                next_worker = (next_worker + 1) % num_workers;
+            }
+            workers[worker]->tasks.push_back(task);
+        }
+    }
+    publish();
+}
+
+bool Task_Scheduler::next(int worker, Vassal_Task& task)
+{
+    // Claim the back slot first, then look whether a thief got there too
+    Worker_Deque& own = *workers[worker];
+    long long b = own.bottom.load(std::memory_order_relaxed) - 1;
+    own.bottom.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    long long t = own.top.load(std::memory_order_relaxed);
+    if (t < b)
+    {
+        task = own.tasks[b];
+        return true;
+    }
+    bool won = false;
+    if (t == b)
+    {
+        // Last task, the owner and the thieves race for it on top
+        won = own.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        if (won)
+            task = own.tasks[b];
+    }
+    own.bottom.store(b + 1, std::memory_order_relaxed);
+    return won || steal(worker, task);
+}
+
+bool Task_Scheduler::steal(int thief, Vassal_Task& task)
+{
+    // Workers on the thief's node first, then the rest
+    int n = static_cast<int>(workers.size());
+    int home = node_of(thief);
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (int offset = 1; offset < n; ++offset)
+        {
+            int v = (thief + offset) % n;
+            if ((node_of(v) == home) != (pass == 0))
+                continue;
+            Worker_Deque& victim = *workers[v];
+            // A lost CAS means another worker took the front, look again
+            for (;;)
+            {
+                long long t = victim.top.load(std::memory_order_acquire);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                long long b = victim.bottom.load(std::memory_order_acquire);
+                if (t >= b)
+                    break;
+                if (victim.top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+                {
+                    task = victim.tasks[t];
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
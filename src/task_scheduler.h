@@ -0,0 +1,66 @@
+#ifndef TASK_SCHEDULER_H
+#define TASK_SCHEDULER_H
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+// A slice [first, first + count) of the vassals of one empire
+struct Vassal_Task
+{
+    int empire;
+    int first;
+    int count;
+    int chunk;      // index of the slice within its empire
+};
+
+// Work-stealing scheduler for the per-empire phases. Empires are cut into
+// chunks, so one huge empire still spreads over every worker. Each worker
+// owns a deque, takes from its back and, once empty, steals from the front
+// of the others, which keeps the load even when empire sizes are skewed.
+// The deques are Chase-Lev without the push side: every task is dealt out
+// before the phase, so the owner pops without a lock and only the last task
+// of a deque is settled with a CAS against the thieves.
+class Task_Scheduler
+{
+    struct alignas(64) Worker_Deque
+    {
+        std::vector<Vassal_Task> tasks;     // filled by distribute, read only while running
+        alignas(64) std::atomic<long long> top{ 0 };    // thieves take here
+        alignas(64) std::atomic<long long> bottom{ 0 }; // the owner takes below here
+    };
+
+    void reset(int num_workers);
+    void publish();
+
+    std::vector<std::unique_ptr<Worker_Deque>> workers;
+    std::vector<int> worker_node;
+
+    int node_of(int worker) const;
+
+    bool steal(int thief, Vassal_Task& task);
+
+public:
+    // Chunk size for a phase over total vassals and the given number of
+    // workers: several chunks per worker, but not so small the overhead shows
+    static int chunk_size(int total, int num_workers);
+
+    // Cut every empire into chunks and deal them out over num_workers deques
+    void distribute(const std::vector<int>& empire_sizes, int num_workers, int chunk);
+
+    // NUMA node of each worker, empty puts every worker on one node. Idle
+    // workers steal from their own node before crossing to another.
+    void set_worker_nodes(const std::vector<int>& nodes);
+
+    // Same chunks, but each goes round robin over the workers of the node
+    // home_node picks for it, so the work stays next to its data
+    void distribute(const std::vector<int>& empire_sizes, int num_workers, int chunk,
+        const std::function<int(const Vassal_Task&)>& home_node);
+
+    // Next task for worker, false once every deque is empty. distribute must
+    // happen before any worker calls it, behind a barrier
+    bool next(int worker, Vassal_Task& task);
+};
+
+#endif
@@ -0,0 +1,58 @@
+#include "tournament_tree.h"
+#include "country.h"
+#include <utility>
+
+Tournament_Tree::Tournament_Tree(std::pmr::memory_resource* resource)
+    : nodes(2, -1, resource), capacity(1)
+{}
+
+int Tournament_Tree::winner(int a, int b, const std::pmr::vector<Country*>& vassals) const
+{
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    if (vassals[b]->fitness < vassals[a]->fitness)
+        return b;
+    return a;
+}
+
+void Tournament_Tree::rebuild(const std::pmr::vector<Country*>& vassals)
+{
+    int size = static_cast<int>(vassals.size());
+    capacity = 1;
+    while (capacity < size)
+        capacity *= 2;
+
+    nodes.assign(2 * capacity, -1);
+    for (int i = 0; i < size; ++i)
+        nodes[capacity + i] = i;
+    for (int node = capacity - 1; node >= 1; --node)
+        nodes[node] = winner(nodes[2 * node], nodes[2 * node + 1], vassals);
+}
+
+void Tournament_Tree::update(int position, const std::pmr::vector<Country*>& vassals)
+{
+    // Grow by doubling, the rebuild is amortized over the appends
+    if (position >= capacity)
+    {
+        rebuild(vassals);
+        return;
+    }
+
+    int node = capacity + position;
+    nodes[node] = position < static_cast<int>(vassals.size()) ? position : -1;
+    for (node /= 2; node >= 1; node /= 2)
+        nodes[node] = winner(nodes[2 * node], nodes[2 * node + 1], vassals);
+}
+
+int Tournament_Tree::weakest() const
+{
+    return nodes[1];
+}
+
+void Tournament_Tree::swap(Tournament_Tree& other)
+{
+    nodes.swap(other.nodes);
+    std::swap(capacity, other.capacity);
+}
@@ -0,0 +1,35 @@
+#ifndef TOURNAMENT_TREE_H
+#define TOURNAMENT_TREE_H
+
+#include <vector>
+#include <memory_resource>
+
+class Country;
+
+// Tournament tree over the positions of a vassal list. Leaves follow the list
+// positions and every inner node holds the weaker of its two children, so the
+// weakest vassal sits at the root and a changed position costs O(log n).
+// Ties go to the lower position, as in a linear scan.
+class Tournament_Tree
+{
+    std::pmr::vector<int> nodes;    // list position held by each node, -1 when empty
+    int capacity;                   // number of leaves, a power of two
+
+    int winner(int a, int b, const std::pmr::vector<Country*>& vassals) const;
+
+public:
+    explicit Tournament_Tree(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // Rebuild from scratch, after bulk fitness changes
+    void rebuild(const std::pmr::vector<Country*>& vassals);
+
+    // The vassal at position changed, joined or, past the end of the list, left
+    void update(int position, const std::pmr::vector<Country*>& vassals);
+
+    // Position of the vassal with the lowest fitness, -1 for an empty list
+    int weakest() const;
+
+    void swap(Tournament_Tree& other);
+};
+
+#endif
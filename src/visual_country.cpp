@@ -1,42 +1,35 @@
 #include "visual_country.h"
+#include <algorithm>
 
-Visual_Country::Visual_Country(const std::vector<double>& loc):
-	Country(loc), colour({-1.0, -1.0, -1.0})
+Visual_Country::Visual_Country(Population_Store& store, int slot, std::pmr::memory_resource* resource):
+	Country(store, slot, resource), colour({-1.0, -1.0, -1.0})
 {}
 
 void Visual_Country::set_colour(std::vector<double>& colour)
 {
-	this->colour = colour;
+	std::copy(colour.begin(), colour.begin() + this->colour.size(), this->colour.begin());
 }
 
 std::vector<double> Visual_Country::get_colour()
 {
-	return this->colour;
+	return std::vector<double>(colour.begin(), colour.end());
 }
 
 void Visual_Country::add_vassal(Country* vassal)
 {
-	vassals.push_back(vassal);
-	auto vc = static_cast<Visual_Country*>(vassal);
-	vc->set_colour(this->colour);
+	Country::add_vassal(vassal);
+	static_cast<Visual_Country*>(vassal)->colour = colour;
 }
 
 void Visual_Country::add_emperor(Country* emperor)
 {
 	vassal_of_empire = emperor;
-	auto vc = static_cast<Visual_Country*>(emperor);
-	std::vector<double> temp = vc->get_colour();
-	this->set_colour(temp);
+	colour = static_cast<Visual_Country*>(emperor)->colour;
 }
 
 void Visual_Country::coup(Country* nearest_imperialist)
 {
-	auto vc = static_cast<Visual_Country*>(nearest_imperialist);
-	std::vector<double> temp = vc->get_colour();
-	this->set_colour(temp);
+	colour = static_cast<Visual_Country*>(nearest_imperialist)->colour;
 
-	this->vassals = nearest_imperialist->vassals;
-	this->add_vassal(nearest_imperialist);
-	nearest_imperialist->add_emperor(this);
-	this->vassal_of_empire = nullptr;
+	Country::coup(nearest_imperialist);
 }
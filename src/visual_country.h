@@ -2,13 +2,14 @@
 #define VISUAL_COUNTRY_H
 
 #include "country.h"
+#include <array>
 
 class Visual_Country : public Country
 {
-	std::vector<double> colour;
+	std::array<double, 3> colour;
 
 public:
-	Visual_Country(const std::vector<double>& loc);
+	Visual_Country(Population_Store& store, int slot, std::pmr::memory_resource* resource = std::pmr::get_default_resource());
 	void set_colour(std::vector<double>& colour);
 	std::vector<double> get_colour();
 
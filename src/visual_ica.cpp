@@ -1,6 +1,4 @@
 #include "visual_ica.h"
-#include <random>
-#include <ctime>
 
 
 void Visual_ICA::state_snapshot(std::string phase_name)
@@ -22,9 +20,9 @@ void Visual_ICA::state_snapshot(std::string phase_name)
 
 std::vector<double> Visual_ICA::random_colour()
 {
-    static std::default_random_engine gen(std::random_device{}());
-    std::uniform_real_distribution<double> dist(0.0, 1.0);
-    return { dist(gen), dist(gen), dist(gen) };
+    std::vector<double> colour(3);
+    rng().fill_uniform(colour.data(), colour.size());
+    return colour;
 }
 
 void Visual_ICA::empire_colouring()
@@ -51,32 +49,38 @@ Visual_ICA::Visual_ICA(
     double eta, 
     double lb, 
     double ub, 
-    const std::function<double(const std::vector<double>&)>& obj_func)
-    :ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func)
+    const std::function<double(const std::vector<double>&)>& obj_func,
+    unsigned long long seed)
+    :ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, obj_func, seed)
 {}
 
-void Visual_ICA::setup()
+Visual_ICA::Visual_ICA(
+    int pop_size, 
+    int dim, 
+    int max_iter, 
+    double beta, 
+    double gamma, 
+    double eta, 
+    double lb, 
+    double ub, 
+    const Batch_Objective_Function& batch_obj_func,
+    unsigned long long seed)
+    :ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, batch_obj_func, seed)
+{}
+
+void Visual_ICA::reserve_countries()
 {
-    std::srand(static_cast<unsigned int>(std::time(nullptr)));
+    country_arena.reserve(pop_size, sizeof(Visual_Country), alignof(Visual_Country));
+}
 
-    for (size_t i = 0; i < pop_size; ++i)
-    {
-        std::vector<double> pos(dim);
-        for (int j = 0; j < dim; ++j)
-        {
-            double r = static_cast<double>(std::rand()) / (RAND_MAX + 1.0);
-            pos[j] = lb + r * (ub - lb);
-        }
-        population.push_back(new Visual_Country(pos));
-    }
+Country* Visual_ICA::create_country(int slot)
+{
+    return new (country_arena.storage(slot)) Visual_Country(store, slot, country_arena.resource());
+}
 
-    calculate_fitness();
-    std::sort(population.begin(), population.end(), [](Country* a, Country* b)
-        {
-            return a->fitness < b->fitness;
-        });
-    create_empires();
-    create_colonies();
+void Visual_ICA::form_empires()
+{
+    ICA::form_empires();
     empire_colouring();
 }
 
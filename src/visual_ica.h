@@ -21,8 +21,17 @@ public:
     std::vector<double> random_colour();
     void empire_colouring();
 
-    Visual_ICA(int pop_size, int dim, int max_iter, double beta, double gamma, double eta, double lb, double ub, const std::function<double(const std::vector<double>&)>& obj_func);
-    void setup() override;
+    Visual_ICA(int pop_size, int dim, int max_iter, double beta, double gamma, double eta, double lb, double ub, const std::function<double(const std::vector<double>&)>& obj_func, unsigned long long seed = random_seed());
+    Visual_ICA(int pop_size, int dim, int max_iter, double beta, double gamma, double eta, double lb, double ub, const Batch_Objective_Function& batch_obj_func, unsigned long long seed = random_seed());
+    template<class Objective, class = std::enable_if_t<is_single_objective_v<Objective>>>
+    Visual_ICA(int pop_size, int dim, int max_iter, double beta, double gamma, double eta, double lb, double ub, Objective objective, unsigned long long seed = random_seed())
+        : Visual_ICA(pop_size, dim, max_iter, beta, gamma, eta, lb, ub, make_static_batch_objective(objective), seed)
+    {
+        obj_func = make_static_objective(objective);
+    }
+    void reserve_countries() override;
+    Country* create_country(int slot) override;
+    void form_empires() override;
     void run() override;
 
     std::vector<std::pair<std::string, std::vector<Visual_Country_Snapshot>>> get_history();
@@ -1,7 +1,10 @@
 #include "../ICA_GUI/ica.h"
 #include "../ICA_GUI/visual_ica.h"
+#include "../ICA_GUI/history_codec.h"
+#include "../ICA_GUI/blocked_distance.h"
 #include "gtest/gtest.h"
 #include "testing_functions.h"
+#include <algorithm>
 
 // ============================================================================
 // ICA Constructor Tests
@@ -78,6 +81,189 @@ TEST(ICA, CalculateFitnessUpdatesValues)
     EXPECT_EQ(ica.best_solution.size(), 2);
 }
 
+TEST(ICA, BatchObjectiveCalledOncePerPhase) 
+{
+    int calls = 0;
+    int evaluated = 0;
+    Batch_Objective_Function counting = [&](const double* positions, int count, int dim, int stride, double* fitness)
+        {
+            ++calls;
+            evaluated += count;
+            sphere_batch_function(positions, count, dim, stride, fitness);
+        };
+
+    ICA ica(20, 10, 50, 2.0, 0.1, 0.1, -10.0, 10.0, counting);
+    ica.setup();
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(evaluated, 20);
+
+    // Nothing moved, so there is nothing to evaluate
+    ica.calculate_fitness();
+    EXPECT_EQ(calls, 1);
+    EXPECT_EQ(ica.get_evaluations_saved(), 20);
+
+    // Only the colonies move in revolution, emperors keep their fitness
+    ica.revolution();
+    ica.calculate_fitness();
+    EXPECT_EQ(calls, 2);
+    EXPECT_EQ(evaluated, 20 + static_cast<int>(ica.colonies.size()));
+    EXPECT_EQ(ica.evaluations_saved, 20 + static_cast<long long>(ica.empires.size()));
+    for (auto* country : ica.population) 
+    {
+        EXPECT_DOUBLE_EQ(country->fitness, sphere_function(country->location));
+    }
+}
+
+TEST(ICA, MigrationWithKnownFitnessSkipsEvaluation) 
+{
+    int evaluated = 0;
+    Batch_Objective_Function counting = [&](const double* positions, int count, int dim, int stride, double* fitness)
+        {
+            evaluated += count;
+            sphere_batch_function(positions, count, dim, stride, fitness);
+        };
+
+    ICA ica(30, 4, 10, 2.0, 0.1, 0.1, -5.0, 5.0, counting);
+    ica.setup();
+    int before = evaluated;
+
+    std::vector<double> elite(4, 0.0);
+    ica.migrate_best(elite, sphere_function(elite));
+    ica.calculate_fitness();
+
+    EXPECT_EQ(evaluated, before);
+    EXPECT_DOUBLE_EQ(ica.get_fitness(), 0.0);
+}
+
+TEST(ICA, PackElitesBestFirst) 
+{
+    ICA ica(30, 3, 10, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 8);
+    ica.setup();
+
+    std::vector<double> records = ica.pack_elites(4);
+    ASSERT_EQ(records.size(), 4u * 4);
+    std::vector<double> fitness;
+    for (auto* country : ica.population)
+        fitness.push_back(country->fitness);
+    std::sort(fitness.begin(), fitness.end());
+    for (int i = 0; i < 4; ++i)
+    {
+        EXPECT_DOUBLE_EQ(records[i * 4 + 3], fitness[i]);
+        std::vector<double> location(records.begin() + i * 4, records.begin() + i * 4 + 3);
+        EXPECT_DOUBLE_EQ(sphere_function(location), fitness[i]);
+    }
+}
+
+TEST(ICA, PackElitesAfterRunCarriesExactFitness) 
+{
+    // run() ends with moved countries whose fitness is from before the move
+    ICA ica(40, 3, 7, 2.0, 0.3, 0.5, -5.0, 5.0, sphere_function, 12);
+    ica.setup();
+    ica.run();
+
+    const int k = 10;
+    std::vector<double> records = ica.pack_elites(k);
+    ASSERT_EQ(records.size(), static_cast<size_t>(k) * 4);
+    for (int i = 0; i < k; ++i)
+    {
+        std::vector<double> location(records.begin() + i * 4, records.begin() + i * 4 + 3);
+        EXPECT_DOUBLE_EQ(records[i * 4 + 3], sphere_function(location));
+        EXPECT_GE(records[i * 4 + 3], ica.get_fitness());
+    }
+}
+
+TEST(ICA, ReceivedElitesAreNotEvaluated) 
+{
+    const Receive_Policy policies[] = { Receive_Policy::Replace_Worst, Receive_Policy::Replace_Random, Receive_Policy::Replace_Weakest_Empire };
+    for (Receive_Policy policy : policies)
+    {
+        int evaluated = 0;
+        Batch_Objective_Function counting = [&](const double* positions, int count, int dim, int stride, double* fitness)
+            {
+                evaluated += count;
+                sphere_batch_function(positions, count, dim, stride, fitness);
+            };
+
+        ICA sender(30, 3, 10, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 1);
+        ICA receiver(30, 3, 10, 2.0, 0.1, 0.1, -5.0, 5.0, counting, 2);
+        sender.setup();
+        receiver.setup();
+        std::vector<double> records = sender.pack_elites(3);
+
+        // The weakest empire gives up its worst vassals
+        if (policy == Receive_Policy::Replace_Weakest_Empire)
+        {
+            std::vector<Country*> targets = receiver.migration_targets(3, policy);
+            for (auto* country : targets)
+                EXPECT_EQ(static_cast<Country*>(country->vassal_of_empire), static_cast<Country*>(targets[0]->vassal_of_empire));
+        }
+
+        int before = evaluated;
+        receiver.receive_elites(records.data(), 3, policy);
+        receiver.calculate_fitness();
+        EXPECT_EQ(evaluated, before);
+        EXPECT_LE(receiver.get_fitness(), sender.get_fitness());
+
+        for (int i = 0; i < 3; ++i)
+        {
+            std::vector<double> location(records.begin() + i * 4, records.begin() + i * 4 + 3);
+            bool found = false;
+            for (auto* country : receiver.population)
+                found = found || country->location == location;
+            EXPECT_TRUE(found);
+        }
+
+        // The vassal aggregates followed the replaced fitness values
+        for (auto* empire : receiver.empires)
+        {
+            double sum = 0;
+            for (auto* vassal : empire->vassals)
+                sum += vassal->fitness;
+            EXPECT_NEAR(empire->vassal_fitness_sum, sum, 1e-9);
+        }
+    }
+}
+
+TEST(ICA, WrappedObjectiveMatchesBatchObjective) 
+{
+    Batch_Objective_Function wrapped = make_batch_objective(sphere_function);
+    std::vector<double> positions = { 1.0, 2.0, 0.0, 3.0, -1.0, 0.0 };
+    std::vector<double> wrapped_fitness(2), batch_fitness(2);
+
+    wrapped(positions.data(), 2, 2, 3, wrapped_fitness.data());
+    sphere_batch_function(positions.data(), 2, 2, 3, batch_fitness.data());
+
+    EXPECT_EQ(wrapped_fitness, batch_fitness);
+    EXPECT_DOUBLE_EQ(wrapped_fitness[0], 5.0);
+    EXPECT_DOUBLE_EQ(make_single_objective(sphere_batch_function)({ 3.0, 4.0 }), 25.0);
+}
+
+struct Pointer_Sphere
+{
+    double operator()(const double* x, int dim) const
+    {
+        double sum = 0;
+        for (int d = 0; d < dim; ++d)
+            sum += x[d] * x[d];
+        return sum;
+    }
+};
+
+TEST(ICA, StaticObjectiveMatchesStdFunction) 
+{
+    std::function<double(const std::vector<double>&)> wrapped = sphere_function;
+    ICA dynamic(60, 8, 30, 2.0, 0.1, 0.1, -5.0, 5.0, wrapped, 11);
+    ICA inlined(60, 8, 30, 2.0, 0.1, 0.1, -5.0, 5.0, Pointer_Sphere(), 11);
+    dynamic.setup();
+    inlined.setup();
+    dynamic.run();
+    inlined.run();
+
+    EXPECT_EQ(dynamic.get_fitness(), inlined.get_fitness());
+    EXPECT_EQ(dynamic.get_best_solution(), inlined.get_best_solution());
+    EXPECT_DOUBLE_EQ(inlined.obj_func({ 3.0, 4.0 }), 25.0);
+}
+
 // ============================================================================
 // ICA Empire Creation Tests
 // ============================================================================
@@ -242,6 +428,35 @@ TEST(ICA, MigrateBestReplacesWorst)
     EXPECT_TRUE(found);
 }
 
+TEST(ICA, MigrantsNeverReplaceEmperors) 
+{
+    ICA ica(30, 3, 50, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 4);
+    ica.setup();
+
+    // Make the emperors the worst countries of the island
+    std::vector<std::vector<double>> emperor_locations;
+    for (auto* emperor : ica.empires)
+    {
+        ica.store.fitness[emperor->slot] = 1e9;
+        emperor_locations.push_back(emperor->location);
+    }
+
+    std::vector<double> records;
+    for (int i = 0; i < 5; ++i)
+    {
+        records.insert(records.end(), { 0.1 * i, 0.0, 0.0 });
+        records.push_back(0.01 * i * i);
+    }
+    ica.receive_elites(records.data(), 5, Receive_Policy::Replace_Worst);
+    ica.migrate_best({ 0.0, 0.5, 0.0 }, sphere_function);
+
+    for (size_t e = 0; e < ica.empires.size(); ++e)
+    {
+        EXPECT_TRUE(ica.store.is_emperor(ica.empires[e]->slot));
+        EXPECT_EQ(ica.empires[e]->location, emperor_locations[e]);
+    }
+}
+
 // ============================================================================
 // ICA Setter Tests
 // ============================================================================
@@ -272,6 +487,481 @@ TEST(ICA, GettersReturnCorrectValues)
     EXPECT_EQ(solution.size(), 3);
 }
 
+// ============================================================================
+// RNG Tests
+// ============================================================================
+
+TEST(RNG, UniformStaysInRange) 
+{
+    RNG rng(42, 0);
+    std::vector<double> values(1001);
+    rng.fill_uniform(values.data(), values.size(), -2.0, 3.0);
+
+    for (double v : values) 
+    {
+        EXPECT_GE(v, -2.0);
+        EXPECT_LT(v, 3.0);
+    }
+    EXPECT_NE(values[0], values[1]);
+}
+
+TEST(RNG, StreamsAreIndependentAndReproducible) 
+{
+    RNG a(7, 0), b(7, 0), c(7, 1);
+    bool differs = false;
+    for (int i = 0; i < 16; ++i) 
+    {
+        double x = a.uniform();
+        EXPECT_EQ(x, b.uniform());
+        differs |= (x != c.uniform());
+    }
+    EXPECT_TRUE(differs);
+}
+
+TEST(ICA, SameSeedReproducesRun) 
+{
+    ICA first(40, 3, 30, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 1234);
+    ICA second(40, 3, 30, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 1234);
+    first.setup();
+    second.setup();
+    first.run();
+    second.run();
+
+    EXPECT_EQ(first.best_fitness, second.best_fitness);
+    EXPECT_EQ(first.best_solution, second.best_solution);
+}
+
+// ============================================================================
+// Phase Kernel Tests
+// ============================================================================
+
+TEST(Phase_Kernels, VectorKernelsMatchScalar) 
+{
+    const int dim = 13;
+    const int stride = 16;
+    std::vector<int> rows = { 2, 0, 3 };
+    RNG rng(99, 0);
+
+    std::vector<double> base(4 * stride), target(dim), uniforms(rows.size()), noise(rows.size() * dim);
+    rng.fill_uniform(base.data(), base.size(), -5.0, 5.0);
+    rng.fill_uniform(target.data(), dim, -5.0, 5.0);
+    rng.fill_uniform(uniforms.data(), uniforms.size());
+    rng.fill_uniform(noise.data(), noise.size(), -0.1, 0.1);
+
+    const Phase_Kernels& scalar = phase_kernels(Kernel_Isa::scalar);
+    std::vector<double> expected = base;
+    scalar.assimilate(expected.data(), stride, rows.data(), rows.size(), target.data(), dim, 2.0, uniforms.data());
+    scalar.revolve(expected.data(), stride, rows.data(), rows.size(), dim, noise.data());
+
+    for (Kernel_Isa isa : { Kernel_Isa::avx2, Kernel_Isa::avx512 }) 
+    {
+        if (!kernel_isa_supported(isa))
+            continue;
+
+        const Phase_Kernels& kernels = phase_kernels(isa);
+        std::vector<double> actual = base;
+        kernels.assimilate(actual.data(), stride, rows.data(), rows.size(), target.data(), dim, 2.0, uniforms.data());
+        kernels.revolve(actual.data(), stride, rows.data(), rows.size(), dim, noise.data());
+
+        for (size_t i = 0; i < actual.size(); ++i)
+            EXPECT_NEAR(actual[i], expected[i], 1e-12);
+
+        EXPECT_NEAR(kernels.squared_distance(base.data(), target.data(), dim),
+            scalar.squared_distance(base.data(), target.data(), dim), 1e-9);
+    }
+}
+
+TEST(Phase_Kernels, FixedDimKernelsMatchDynamic) 
+{
+    const int stride = 32;
+    std::vector<int> rows = { 1, 3, 0 };
+    RNG rng(7, 0);
+
+    for (int dim : { 2, 8, 16, 30 }) 
+    {
+        ASSERT_TRUE(fixed_dim_supported(dim));
+        std::vector<double> base(4 * stride), target(dim), uniforms(rows.size()), noise(rows.size() * dim);
+        rng.fill_uniform(base.data(), base.size(), -5.0, 5.0);
+        rng.fill_uniform(target.data(), dim, -5.0, 5.0);
+        rng.fill_uniform(uniforms.data(), uniforms.size());
+        rng.fill_uniform(noise.data(), noise.size(), -0.1, 0.1);
+
+        const Phase_Kernels& dynamic = phase_kernels(Kernel_Isa::scalar);
+        std::vector<double> expected = base;
+        dynamic.assimilate(expected.data(), stride, rows.data(), rows.size(), target.data(), dim, 2.0, uniforms.data());
+        dynamic.revolve(expected.data(), stride, rows.data(), rows.size(), dim, noise.data());
+
+        for (Kernel_Isa isa : { Kernel_Isa::scalar, Kernel_Isa::avx2, Kernel_Isa::avx512 }) 
+        {
+            const Phase_Kernels& fixed = phase_kernels(isa, dim);
+            EXPECT_EQ(fixed.fixed_dim, dim);
+
+            std::vector<double> actual = base;
+            fixed.assimilate(actual.data(), stride, rows.data(), rows.size(), target.data(), dim, 2.0, uniforms.data());
+            fixed.revolve(actual.data(), stride, rows.data(), rows.size(), dim, noise.data());
+            for (size_t i = 0; i < actual.size(); ++i)
+                EXPECT_NEAR(actual[i], expected[i], 1e-12);
+
+            EXPECT_NEAR(fixed.squared_distance(base.data(), target.data(), dim),
+                dynamic.squared_distance(base.data(), target.data(), dim), 1e-9);
+        }
+    }
+
+    EXPECT_EQ(phase_kernels_for_dim(13).fixed_dim, 0);
+}
+
+// ============================================================================
+// Empire Index Tests
+// ============================================================================
+
+static int brute_force_nearest(const std::vector<Country*>& empires, const double* location, int dim)
+{
+    int best = 0;
+    double best_dist = INFINITY;
+    for (size_t i = 0; i < empires.size(); ++i) 
+    {
+        double d = phase_kernels(Kernel_Isa::scalar).squared_distance(empires[i]->location.data(), location, dim);
+        if (d < best_dist) 
+        {
+            best_dist = d;
+            best = i;
+        }
+    }
+    return best;
+}
+
+TEST(Empire_Index, NearestMatchesBruteForce) 
+{
+    for (int dim : { 2, 8, 40 }) 
+    {
+        ICA ica(200, dim, 50, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 5);
+        ica.setup();
+
+        Empire_Index index;
+        index.build(ica.empires, dim, ica.kernels);
+        EXPECT_EQ(index.uses_tree(), dim <= Empire_Index::KD_TREE_MAX_DIM);
+
+        for (auto* colony : ica.colonies) 
+        {
+            EXPECT_EQ(index.nearest(colony->location.data()),
+                brute_force_nearest(ica.empires, colony->location.data(), dim));
+        }
+    }
+}
+
+TEST(Empire_Index, ReplacedEmperorsStayExact) 
+{
+    ICA ica(200, 3, 50, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 6);
+    ica.setup();
+
+    Empire_Index index;
+    index.build(ica.empires, 3, ica.kernels);
+
+    // Swap two emperors for colonies far away from their old location
+    for (int k : { 0, 7 }) 
+    {
+        Country* colony = ica.empires[k]->vassals.back();
+        colony->coup(ica.empires[k]);
+        ica.empires[k] = colony;
+        index.replace(k, colony);
+    }
+
+    for (auto* country : ica.population) 
+    {
+        EXPECT_EQ(index.nearest(country->location.data()),
+            brute_force_nearest(ica.empires, country->location.data(), 3));
+    }
+}
+
+TEST(Empire_Index, BlockedBatchMatchesBruteForce) 
+{
+    int dim = 64;
+    ICA ica(600, dim, 50, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 7);
+    ica.setup();
+
+    Empire_Index index;
+    index.build(ica.empires, dim, ica.kernels);
+    ASSERT_FALSE(index.uses_tree());
+
+    std::vector<int> rows;
+    for (auto* colony : ica.colonies)
+        rows.push_back(colony->slot);
+    std::vector<int> nearest(rows.size());
+    index.nearest_batch(ica.store, rows.data(), rows.size(), nearest.data());
+
+    for (size_t c = 0; c < ica.colonies.size(); ++c)
+        EXPECT_EQ(nearest[c], brute_force_nearest(ica.empires, ica.colonies[c]->location.data(), dim));
+}
+
+TEST(Empire_Index, BlockedBatchExactForConvergedColonies) 
+{
+    // Emperors a micron apart far from the origin, where the expansion
+    // ||q||^2 + ||r||^2 - 2 q.r has no significant digits left
+    int dim = 32, count = 8;
+    std::vector<double> references(static_cast<size_t>(count) * dim, 1000.0);
+    std::vector<double> queries(static_cast<size_t>(count) * dim, 1000.0);
+    std::vector<int> rows(count);
+    for (int k = 0; k < count; ++k)
+    {
+        references[static_cast<size_t>(k) * dim] += k * 1e-6;
+        queries[static_cast<size_t>(count - 1 - k) * dim] += (k + 0.3) * 1e-6;
+        rows[k] = k;
+    }
+
+    const Phase_Kernels& kernels = phase_kernels(Kernel_Isa::scalar);
+    std::vector<int> nearest(count);
+    blocked_nearest(queries.data(), dim, rows.data(), count, references.data(), count, dim, nearest.data(), kernels.squared_distance);
+    for (int q = 0; q < count; ++q)
+        EXPECT_EQ(nearest[q], count - 1 - q);
+}
+
+TEST(Distance_Bounds, BoundedMutinyMatchesFullSearch) 
+{
+    ICA plain(300, 4, 60, 2.0, 0.05, 0.1, -5.0, 5.0, sphere_function, 21);
+    ICA bounded(300, 4, 60, 2.0, 0.05, 0.1, -5.0, 5.0, sphere_function, 21);
+    bounded.use_distance_bounds = true;
+
+    plain.setup();
+    bounded.setup();
+    plain.run();
+    bounded.run();
+
+    EXPECT_EQ(plain.best_fitness, bounded.best_fitness);
+    EXPECT_EQ(plain.empires.size(), bounded.empires.size());
+    EXPECT_GT(bounded.distance_bounds.distance_computations_skipped, 0);
+}
+
+// ============================================================================
+// Population Store Tests
+// ============================================================================
+
+TEST(Population_Store, CountriesViewContiguousRows) 
+{
+    ICA ica(30, 10, 50, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function);
+    ica.setup();
+
+    EXPECT_EQ(ica.store.stride % 8, 0);
+    for (auto* country : ica.population) 
+    {
+        EXPECT_EQ(country->location.data(), ica.store.row(country->slot));
+        EXPECT_EQ(&country->fitness, &ica.store.fitness[country->slot]);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(country->location.data()) % 64, 0);
+    }
+}
+
+TEST(Population_Store, AssigningWrongLengthThrows) 
+{
+    ICA ica(30, 10, 50, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function);
+    ica.setup();
+
+    Location_View location = ica.population[0]->location;
+    std::vector<double> before = location;
+    EXPECT_THROW(location = std::vector<double>(9, 1.0), std::invalid_argument);
+    EXPECT_THROW(location = std::vector<double>(11, 1.0), std::invalid_argument);
+    EXPECT_EQ(location, before);
+
+    location = std::vector<double>(10, 1.0);
+    EXPECT_EQ(location, std::vector<double>(10, 1.0));
+}
+
+TEST(Population_Store, ReallocatedPositionsArePageAligned) 
+{
+    Population_Store store(10, 3);
+    store.reallocate_positions();
+    store.clear_rows(0, store.size);
+
+#if defined(__unix__) || defined(__APPLE__)
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(store.positions) % 4096, 0u);
+#endif
+    for (int slot = 0; slot < store.size; ++slot)
+        EXPECT_EQ(std::vector<double>(store.row(slot), store.row(slot) + store.dim), std::vector<double>(3, 0.0));
+}
+
+TEST(Population_Store, EmpireIdsFollowCoup) 
+{
+    ICA ica(40, 3, 50, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function);
+    ica.setup();
+
+    Country* emperor = ica.empires[0];
+    ASSERT_FALSE(emperor->vassals.empty());
+    Country* colony = emperor->vassals[0];
+    std::vector<Country*> others(emperor->vassals.begin() + 1, emperor->vassals.end());
+
+    colony->coup(emperor);
+
+    EXPECT_EQ(colony->vassal_of_empire, nullptr);
+    EXPECT_EQ(emperor->vassal_of_empire, colony);
+    for (auto* vassal : others) 
+    {
+        EXPECT_EQ(vassal->vassal_of_empire, colony);
+    }
+    EXPECT_EQ(colony->vassals.size(), others.size() + 1);
+}
+
+TEST(Country, VassalIndicesStayConsistent) 
+{
+    ICA ica(300, 4, 40, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 9);
+    ica.setup();
+    ica.run();
+
+    for (auto* emperor : ica.empires) 
+    {
+        EXPECT_EQ(emperor->index_in_list, -1);
+        for (size_t j = 0; j < emperor->vassals.size(); ++j) 
+        {
+            EXPECT_EQ(emperor->vassals[j]->index_in_list, static_cast<int>(j));
+            EXPECT_EQ(emperor->vassals[j]->vassal_of_empire, emperor);
+        }
+    }
+
+    // Removal swaps the last vassal into the freed position
+    Country* emperor = ica.empires[0];
+    ASSERT_GE(emperor->vassals.size(), 2u);
+    Country* first = emperor->vassals[0];
+    Country* last = emperor->vassals.back();
+    emperor->remove_vassal(first);
+    EXPECT_EQ(emperor->vassals[0], last);
+    EXPECT_EQ(last->index_in_list, 0);
+    EXPECT_EQ(first->index_in_list, -1);
+}
+
+TEST(Country, AggregatesTrackVassalChanges) 
+{
+    ICA ica(300, 4, 30, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 10);
+    ica.setup();
+
+    // Phases move countries between empires without a fitness refresh at the end
+    ica.calculate_fitness();
+    ica.assimilation();
+    ica.revolution();
+    ica.mutiny();
+    ica.imperial_war();
+    ica.imperial_war();
+
+    auto check_aggregates = [&]()
+    {
+        for (auto* emperor : ica.empires) 
+        {
+            double sum = 0;
+            Country* weakest = nullptr;
+            for (auto* vassal : emperor->vassals) 
+            {
+                sum += vassal->fitness;
+                if (!weakest || vassal->fitness < weakest->fitness)
+                    weakest = vassal;
+            }
+            EXPECT_NEAR(emperor->vassal_fitness_sum, sum, 1e-9 * (1 + std::abs(sum)));
+            if (weakest)
+            {
+                EXPECT_EQ(emperor->vassals[emperor->weakest_vassals.weakest()], weakest);
+            }
+            else
+            {
+                EXPECT_EQ(emperor->weakest_vassals.weakest(), -1);
+            }
+        }
+    };
+    check_aggregates();
+
+    // The next fitness pass updates them through the re-evaluated vassals only
+    ica.calculate_fitness();
+    check_aggregates();
+}
+
+TEST(Evaluation_Cache, QuantizedLookupAndStats) 
+{
+    Evaluation_Cache cache(0.1, 64, 4);
+    double a[2] = { 1.01, -2.02 };
+    double b[2] = { 1.02, -2.03 };
+    double c[2] = { 1.51, -2.02 };
+    double fitness = 0;
+
+    EXPECT_FALSE(cache.lookup(a, 2, fitness));
+    cache.insert(a, 2, 42.0);
+    EXPECT_TRUE(cache.lookup(b, 2, fitness));
+    EXPECT_DOUBLE_EQ(fitness, 42.0);
+    EXPECT_FALSE(cache.lookup(c, 2, fitness));
+
+    EXPECT_EQ(cache.hits(), 1);
+    EXPECT_EQ(cache.misses(), 2);
+}
+
+TEST(Evaluation_Cache, RejectsNonPositiveTolerance) 
+{
+    EXPECT_THROW(Evaluation_Cache(0.0, 64), std::invalid_argument);
+    EXPECT_THROW(Evaluation_Cache(-0.1, 64), std::invalid_argument);
+    EXPECT_THROW(Evaluation_Cache(std::nan(""), 64), std::invalid_argument);
+}
+
+TEST(Evaluation_Cache, UnquantizableLocationsAreNotCached) 
+{
+    Evaluation_Cache cache(1e-12, 64, 1);
+    double far[2] = { 1e10, 0.0 };
+    double infinite[2] = { INFINITY, 0.0 };
+    double undefined[2] = { std::nan(""), 0.0 };
+    double fitness = 0;
+
+    for (double* location : { far, infinite, undefined })
+    {
+        cache.insert(location, 2, 1.0);
+        EXPECT_FALSE(cache.lookup(location, 2, fitness));
+    }
+    EXPECT_EQ(cache.size(), 0u);
+}
+
+TEST(Evaluation_Cache, EvictionKeepsCapacity) 
+{
+    Evaluation_Cache cache(1.0, 32, 1);
+    for (int i = 0; i < 1000; ++i) 
+    {
+        double x[1] = { static_cast<double>(i) };
+        cache.insert(x, 1, i);
+    }
+    EXPECT_EQ(cache.size(), 32u);
+
+    // The most recent insertions survive
+    double fitness = 0;
+    double last[1] = { 999.0 };
+    EXPECT_TRUE(cache.lookup(last, 1, fitness));
+    EXPECT_DOUBLE_EQ(fitness, 999.0);
+}
+
+TEST(ICA, EvaluationCacheSavesRepeatedLocations) 
+{
+    int evaluated = 0;
+    Batch_Objective_Function counting = [&](const double* positions, int count, int dim, int stride, double* fitness)
+        {
+            evaluated += count;
+            sphere_batch_function(positions, count, dim, stride, fitness);
+        };
+
+    ICA ica(40, 3, 10, 2.0, 0.1, 0.1, -5.0, 5.0, counting);
+    ica.enable_evaluation_cache(1e-9, 1024);
+    ica.setup();
+    EXPECT_EQ(evaluated, 40);
+
+    // Moving every colony and moving it back only hits the cache
+    std::vector<std::vector<double>> saved;
+    for (auto* colony : ica.colonies)
+        saved.push_back(colony->location);
+    ica.revolution();
+    ica.calculate_fitness();
+    int after_move = evaluated;
+    for (size_t i = 0; i < ica.colonies.size(); ++i) 
+    {
+        ica.colonies[i]->location = saved[i];
+        ica.store.dirty[ica.colonies[i]->slot] = 1;
+    }
+    ica.calculate_fitness();
+
+    EXPECT_EQ(evaluated, after_move);
+    EXPECT_EQ(ica.evaluation_cache->hits(), static_cast<long long>(ica.colonies.size()));
+    for (auto* country : ica.population) 
+    {
+        EXPECT_DOUBLE_EQ(country->fitness, sphere_function(country->location));
+    }
+}
+
 // ============================================================================
 // Visual ICA Constructor Tests
 // ============================================================================
@@ -459,4 +1149,62 @@ TEST(Visual_ICA, ConvergesToSingleEmpire)
     vica.run();
 
     EXPECT_LE(vica.empires.size(), 5);
-}
\ No newline at end of file
+}
+
+// ============================================================================
+// History Wire Format Tests
+// ============================================================================
+
+TEST(History_Codec, RoundTripIsExact) 
+{
+    Visual_ICA visual_ica(40, 3, 5, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 12);
+    visual_ica.setup();
+    visual_ica.run();
+    visual_ica.history.emplace_back("Final", visual_ica.history.back().second);
+
+    std::vector<unsigned char> buffer;
+    encode_history(visual_ica.history, 3, false, buffer);
+    Visual_History decoded = decode_history(buffer.data(), buffer.size());
+
+    ASSERT_EQ(decoded.size(), visual_ica.history.size());
+    for (size_t s = 0; s < decoded.size(); ++s)
+    {
+        EXPECT_EQ(decoded[s].first, visual_ica.history[s].first);
+        ASSERT_EQ(decoded[s].second.size(), visual_ica.history[s].second.size());
+        for (size_t c = 0; c < decoded[s].second.size(); ++c)
+        {
+            const auto& original = visual_ica.history[s].second[c];
+            const auto& copy = decoded[s].second[c];
+            EXPECT_EQ(copy.position, original.position);
+            EXPECT_EQ(copy.colour, original.colour);
+            EXPECT_EQ(copy.is_emperor, original.is_emperor);
+        }
+    }
+}
+
+TEST(History_Codec, FloatPositionsAreCompact) 
+{
+    int dim = 2;
+    Visual_ICA visual_ica(60, dim, 5, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 4);
+    visual_ica.setup();
+    visual_ica.run();
+
+    // The old encoding spent a double on every name character, the dim,
+    // the flag and each colour channel of every country
+    size_t old_bytes = sizeof(double);
+    for (const auto& snapshot : visual_ica.history)
+        old_bytes += sizeof(double) * (2 + snapshot.first.size() + snapshot.second.size() * (dim + 5));
+
+    std::vector<unsigned char> full, compact;
+    encode_history(visual_ica.history, dim, false, full);
+    encode_history(visual_ica.history, dim, true, compact);
+    EXPECT_LT(full.size() * 3, old_bytes);
+    EXPECT_LT(compact.size() * 5, old_bytes);
+
+    Visual_History decoded = decode_history(compact.data(), compact.size());
+    ASSERT_EQ(decoded.size(), visual_ica.history.size());
+    for (size_t c = 0; c < decoded.back().second.size(); ++c)
+        for (int d = 0; d < dim; ++d)
+            EXPECT_NEAR(decoded.back().second[c].position[d], visual_ica.history.back().second[c].position[d], 1e-6);
+}
+
@@ -1,6 +1,12 @@
 #include "../ICA_GUI/pica_mp.h"
+#include "../ICA_GUI/pica_hybrid.h"
 #include "gtest/gtest.h"
 #include <mpi.h>
+#include <algorithm>
+#include <iostream>
+#include <chrono>
+#include <mutex>
+#include <thread>
 #include "testing_functions.h"
 
 // ============================================================================
@@ -25,6 +31,54 @@ protected:
     int size;
 };
 
+// Sphere objective that logs every location it evaluates
+struct Evaluation_Log
+{
+    int dim;
+    std::mutex lock;
+    std::vector<double> locations;
+
+    explicit Evaluation_Log(int dim) : dim(dim) {}
+
+    long long rows() const { return static_cast<long long>(locations.size()) / dim; }
+
+    Batch_Objective_Function objective()
+    {
+        return [this](const double* positions, int count, int dim, int stride, double* fitness)
+            {
+                sphere_batch_function(positions, count, dim, stride, fitness);
+                std::lock_guard<std::mutex> guard(lock);
+                for (int i = 0; i < count; ++i)
+                    locations.insert(locations.end(), positions + static_cast<size_t>(i) * stride, positions + static_cast<size_t>(i) * stride + dim);
+            };
+    }
+};
+
+// Locations evaluated more than once over all ranks. Every move lands on a
+// fresh point, so a repeat can only be a migrant evaluated again. Collective.
+static long long evaluated_twice(const Evaluation_Log& log)
+{
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int count = static_cast<int>(log.locations.size());
+    std::vector<int> counts(size), offsets(size, 0);
+    MPI_Allgather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    for (int r = 1; r < size; ++r)
+        offsets[r] = offsets[r - 1] + counts[r - 1];
+    std::vector<double> all(offsets[size - 1] + counts[size - 1]);
+    MPI_Allgatherv(log.locations.data(), count, MPI_DOUBLE, all.data(), counts.data(), offsets.data(), MPI_DOUBLE, MPI_COMM_WORLD);
+
+    std::vector<std::vector<double>> rows;
+    for (size_t first = 0; first < all.size(); first += log.dim)
+        rows.emplace_back(all.begin() + first, all.begin() + first + log.dim);
+    std::sort(rows.begin(), rows.end());
+    long long repeats = 0;
+    for (size_t i = 1; i < rows.size(); ++i)
+        if (rows[i] == rows[i - 1])
+            ++repeats;
+    return repeats;
+}
+
 // ============================================================================
 // PICA_MP Constructor Tests
 // ============================================================================
@@ -157,6 +211,39 @@ TEST_F(PICA_MP_Test, NoDeadlockInCommunication)
     SUCCEED();
 }
 
+TEST_F(PICA_MP_Test, UnevenIslandsFinishWithoutBarriers)
+{
+    // Rank 0 iterates much longer per cycle, the others post and move on.
+    // Few enough iterations that no island ends early with a single empire.
+    int pop_size = rank == 0 ? 200 : 60;
+    int max_iter = 1, cycles = 6, iterations_per_cycle = rank == 0 ? 4 : 1;
+    Evaluation_Log log(4);
+    PICA_MP pica_mp(pop_size, 4, max_iter, 2.0, 0.1, 0.1, -5.0, 5.0,
+        log.objective(), cycles, iterations_per_cycle, false, 3);
+
+    EXPECT_NO_THROW(pica_mp.run());
+
+    // One elite per cycle from the ring neighbour, received with its fitness:
+    // the saved evaluations are the rows every pass skipped plus the migrants
+    long long passes = 1 + max_iter + cycles * iterations_per_cycle;
+    EXPECT_EQ(pica_mp.get_evaluations_saved(), passes * pop_size - log.rows() + cycles);
+    EXPECT_EQ(evaluated_twice(log), 0);
+}
+
+TEST_F(PICA_MP_Test, TimersSplitWaitAndCompute)
+{
+    PICA_MP pica_mp(60, 5, 20, 2.0, 0.1, 0.1, -5.0, 5.0,
+        rastrigin_function, 4, 10, false, 9);
+
+    double start = MPI_Wtime();
+    pica_mp.run();
+    double wall = MPI_Wtime() - start;
+
+    EXPECT_GT(pica_mp.get_compute_time(), 0.0);
+    EXPECT_GE(pica_mp.get_wait_time(), 0.0);
+    EXPECT_LE(pica_mp.get_compute_time() + pica_mp.get_wait_time(), wall + 1e-6);
+}
+
 // ============================================================================
 // PICA_MP Visualization Tests
 // ============================================================================
@@ -311,4 +398,292 @@ TEST_F(PICA_MP_Test, GetBestSolutionReturnsValidSolution)
         EXPECT_GE(val, -5.0);
         EXPECT_LE(val, 5.0);
     }
-}
\ No newline at end of file
+}
+
+// ============================================================================
+// Migration Topology Tests
+// ============================================================================
+
+TEST(Migration_Topology, EveryDestinationListsTheSource)
+{
+    const Migration_Topology topologies[] = {
+        Migration_Topology::Ring, Migration_Topology::Bidirectional_Ring, Migration_Topology::Torus_2D,
+        Migration_Topology::Hypercube, Migration_Topology::Random_Regular, Migration_Topology::Fully_Connected };
+
+    for (Migration_Topology topology : topologies)
+    {
+        for (int size : { 1, 2, 5, 8, 12 })
+        {
+            for (int rank = 0; rank < size; ++rank)
+            {
+                Migration_Neighbours mine = migration_neighbours(topology, rank, size, 3, 99, 4);
+                EXPECT_FALSE(mine.destinations.empty());
+                for (int destination : mine.destinations)
+                {
+                    Migration_Neighbours theirs = migration_neighbours(topology, destination, size, 3, 99, 4);
+                    EXPECT_TRUE(std::binary_search(theirs.sources.begin(), theirs.sources.end(), rank));
+                }
+            }
+        }
+    }
+}
+
+TEST(Migration_Topology, ShapesHaveExpectedDegree)
+{
+    EXPECT_EQ(migration_neighbours(Migration_Topology::Ring, 0, 8, 2, 1, 0).destinations, std::vector<int>({ 1 }));
+    EXPECT_EQ(migration_neighbours(Migration_Topology::Bidirectional_Ring, 0, 8, 2, 1, 0).destinations, std::vector<int>({ 1, 7 }));
+    EXPECT_EQ(migration_neighbours(Migration_Topology::Hypercube, 5, 8, 2, 1, 0).destinations, std::vector<int>({ 1, 4, 7 }));
+    EXPECT_EQ(migration_neighbours(Migration_Topology::Torus_2D, 0, 16, 2, 1, 0).destinations.size(), 4u);
+    EXPECT_EQ(migration_neighbours(Migration_Topology::Fully_Connected, 3, 6, 2, 1, 0).destinations.size(), 5u);
+
+    // Random graphs keep their degree but change between cycles
+    Migration_Neighbours first = migration_neighbours(Migration_Topology::Random_Regular, 0, 32, 3, 1, 0);
+    EXPECT_EQ(first.destinations.size(), 3u);
+    EXPECT_EQ(first.sources.size(), 3u);
+    bool changed = false;
+    for (int cycle = 1; cycle < 8 && !changed; ++cycle)
+        changed = migration_neighbours(Migration_Topology::Random_Regular, 0, 32, 3, 1, cycle).destinations != first.destinations;
+    EXPECT_TRUE(changed);
+}
+
+TEST_F(PICA_MP_Test, EveryTopologyRunsAndReportsTimeToTarget)
+{
+    const std::pair<Migration_Topology, const char*> topologies[] = {
+        { Migration_Topology::Ring, "ring" },
+        { Migration_Topology::Bidirectional_Ring, "bidirectional ring" },
+        { Migration_Topology::Torus_2D, "2D torus" },
+        { Migration_Topology::Hypercube, "hypercube" },
+        { Migration_Topology::Random_Regular, "random 2-regular" },
+        { Migration_Topology::Fully_Connected, "fully connected" } };
+
+    for (const auto& entry : topologies)
+    {
+        PICA_MP pica_mp(60, 6, 20, 2.0, 0.1, 0.1, -5.0, 5.0,
+            rastrigin_function, 8, 10, false, 13 + rank);
+        pica_mp.set_topology(entry.first, 2);
+        EXPECT_NO_THROW(pica_mp.run());
+
+        double seconds = pica_mp.time_to_target(15.0);
+        EXPECT_TRUE(seconds == -1 || seconds > 0);
+        if (rank == 0)
+            std::cout << size << " ranks, " << entry.second << ": time to 15.0 " << seconds << " s" << std::endl;
+    }
+}
+
+TEST_F(PICA_MP_Test, MultiEliteMigrationSkipsEvaluation)
+{
+    const Receive_Policy policies[] = { Receive_Policy::Replace_Worst, Receive_Policy::Replace_Random, Receive_Policy::Replace_Weakest_Empire };
+    for (Receive_Policy policy : policies)
+    {
+        // Few enough iterations that no island ends early with a single empire
+        int pop_size = 60, max_iter = 1, cycles = 4, iterations_per_cycle = 1, elites = 3;
+        Evaluation_Log log(4);
+        PICA_MP pica_mp(pop_size, 4, max_iter, 2.0, 0.1, 0.1, -5.0, 5.0,
+            log.objective(), cycles, iterations_per_cycle, false, 21);
+        pica_mp.set_topology(Migration_Topology::Bidirectional_Ring);
+        pica_mp.set_migration(elites, policy);
+        EXPECT_NO_THROW(pica_mp.run());
+
+        // Three elites from each neighbour every cycle, all taken on trust: the
+        // saved evaluations are the rows every pass skipped plus the migrants
+        int neighbours = size >= 3 ? 2 : 1;
+        long long passes = 1 + max_iter + cycles * iterations_per_cycle;
+        EXPECT_EQ(pica_mp.get_evaluations_saved(), passes * pop_size - log.rows() + cycles * neighbours * elites);
+        EXPECT_EQ(evaluated_twice(log), 0);
+    }
+}
+
+TEST_F(PICA_MP_Test, AsynchronousRunDoesNotWaitForSlowIsland)
+{
+    // Rank 0 is slow to evaluate, the others should not be held back by it
+    Batch_Objective_Function objective = [&](const double* positions, int count, int dim, int stride, double* fitness)
+        {
+            if (rank == 0)
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            sphere_batch_function(positions, count, dim, stride, fitness);
+        };
+
+    PICA_MP pica_mp(40, 3, 5, 2.0, 0.1, 0.1, -5.0, 5.0,
+        objective, 6, rank == 0 ? 5 : 2, false, 17);
+    pica_mp.set_migration(2, Receive_Policy::Replace_Worst);
+    MPI_Barrier(MPI_COMM_WORLD);
+    EXPECT_NO_THROW(pica_mp.run_asynchronous());
+
+    EXPECT_GT(pica_mp.get_compute_time(), 0.0);
+    EXPECT_LT(pica_mp.get_best_fitness(), INFINITY);
+
+    // Waiting on rank 0 every cycle would hold the others until about its last
+    // cycle, on their own they are through their cycles well before it
+    double slow = pica_mp.get_cycles_time();
+    MPI_Bcast(&slow, 1, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    if (rank != 0)
+    {
+        EXPECT_LT(pica_mp.get_cycles_time(), 0.5 * slow);
+    }
+
+    // A lone island reads back its own entry every cycle
+    if (size == 1)
+    {
+        EXPECT_GE(pica_mp.get_evaluations_saved(), 6 * 2);
+    }
+}
+
+TEST_F(PICA_MP_Test, AsynchronousRunWithEveryTopology)
+{
+    const Migration_Topology topologies[] = {
+        Migration_Topology::Ring, Migration_Topology::Bidirectional_Ring, Migration_Topology::Torus_2D,
+        Migration_Topology::Hypercube, Migration_Topology::Random_Regular, Migration_Topology::Fully_Connected };
+
+    for (Migration_Topology topology : topologies)
+    {
+        PICA_MP pica_mp(40, 3, 5, 2.0, 0.1, 0.1, -5.0, 5.0,
+            sphere_function, 4, 4, false, 3 + rank);
+        pica_mp.set_topology(topology, 2);
+        EXPECT_NO_THROW(pica_mp.run_asynchronous());
+        EXPECT_GE(pica_mp.time_to_target(INFINITY), 0.0);
+    }
+}
+
+TEST_F(PICA_MP_Test, EveryRankEndsWithGlobalBest)
+{
+    PICA_MP pica_mp(40, 3, 10, 2.0, 0.1, 0.1, -5.0, 5.0,
+        rastrigin_function, 3, 5, false, 50 + rank);
+    pica_mp.set_monitoring(1);
+    pica_mp.run();
+
+    double fitness = pica_mp.get_best_fitness();
+    std::vector<double> solution = pica_mp.get_best_solution();
+    EXPECT_LE(fitness, pica_mp.get_island_best_fitness());
+    EXPECT_DOUBLE_EQ(rastrigin_function(solution), fitness);
+
+    // The same answer everywhere, and it is the best of all islands
+    double island = pica_mp.get_island_best_fitness();
+    double lowest, highest, best_island;
+    MPI_Allreduce(&fitness, &lowest, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+    MPI_Allreduce(&fitness, &highest, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+    MPI_Allreduce(&island, &best_island, 1, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+    EXPECT_EQ(lowest, highest);
+    EXPECT_EQ(fitness, best_island);
+
+    std::vector<double> root_solution = solution;
+    MPI_Bcast(root_solution.data(), 3, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    EXPECT_EQ(solution, root_solution);
+}
+
+TEST_F(PICA_MP_Test, CompactHistoryGatherDecodesEveryRank)
+{
+    for (bool float_positions : { false, true })
+    {
+        PICA_MP pica_mp(30, 2, 6, 2.0, 0.1, 0.1, -3.0, 3.0,
+            sphere_function, 1, 3, true, 8 + rank);
+        pica_mp.set_history_precision(float_positions);
+        pica_mp.run();
+
+        auto all_histories = pica_mp.gather_visualization_history();
+        if (rank == 0)
+        {
+            ASSERT_EQ(all_histories.size(), static_cast<size_t>(size));
+            for (const auto& history : all_histories)
+            {
+                ASSERT_FALSE(history.empty());
+                EXPECT_EQ(history.front().first, "Assimilation");
+                for (const auto& snapshot : history)
+                {
+                    ASSERT_EQ(snapshot.second.size(), 30u);
+                    for (const auto& country : snapshot.second)
+                    {
+                        EXPECT_EQ(country.position.size(), 2u);
+                        EXPECT_EQ(country.colour.size(), 3u);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// ============================================================================
+// PICA_Hybrid Tests
+// ============================================================================
+
+// main below initializes MPI with MPI_THREAD_FUNNELED, PICA_Hybrid refuses
+// to run with less
+class PICA_Hybrid_Test : public PICA_MP_Test
+{};
+
+TEST_F(PICA_Hybrid_Test, RequiresFunneledThreadSupport)
+{
+    int provided;
+    MPI_Query_thread(&provided);
+    if (provided < MPI_THREAD_FUNNELED)
+    {
+        EXPECT_THROW(PICA_Hybrid(60, 3, 10, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 2, 5, 2), std::runtime_error);
+    }
+    else
+    {
+        EXPECT_NO_THROW(PICA_Hybrid(60, 3, 10, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, 2, 5, 2));
+    }
+}
+
+TEST_F(PICA_Hybrid_Test, LayoutMatchesWorld)
+{
+    PICA_Hybrid hybrid(60, 3, 10, 2.0, 0.1, 0.1, -5.0, 5.0,
+        sphere_function, 2, 5, 2);
+
+    EXPECT_EQ(hybrid.get_rank(), rank);
+    EXPECT_EQ(hybrid.get_size(), size);
+    EXPECT_EQ(hybrid.get_threads_per_rank(), 2);
+    EXPECT_GE(hybrid.get_local_rank(), 0);
+    EXPECT_LT(hybrid.get_local_rank(), size);
+}
+
+TEST_F(PICA_Hybrid_Test, RunCompletesWithMigration)
+{
+    // Few enough iterations that no run ends early with a single empire
+    int pop_size = 80, max_iter = 1, cycles = 3, iterations_per_cycle = 1;
+    Evaluation_Log log(4);
+    PICA_Hybrid hybrid(pop_size, 4, max_iter, 2.0, 0.1, 0.1, -5.0, 5.0,
+        log.objective(), cycles, iterations_per_cycle, 2, false, 41);
+
+    EXPECT_NO_THROW(hybrid.run());
+
+    auto solution = hybrid.get_best_solution();
+    EXPECT_EQ(solution.size(), 4);
+    EXPECT_LT(hybrid.get_best_fitness(), INFINITY);
+
+    // Each fitness pass evaluates some rows and skips the rest, and the one
+    // migrant of every cycle arrives with its fitness and is never evaluated
+    long long passes = 1 + max_iter + cycles * iterations_per_cycle;
+    EXPECT_EQ(hybrid.get_evaluations_saved(), passes * pop_size - log.rows() + cycles);
+    EXPECT_EQ(evaluated_twice(log), 0);
+}
+
+TEST_F(PICA_Hybrid_Test, TimingSplitsComputeAndCommunication)
+{
+    PICA_Hybrid hybrid(200, 10, 20, 2.0, 0.1, 0.1, -5.0, 5.0,
+        rastrigin_function, 5, 10, 2, true, 7);
+
+    double start = MPI_Wtime();
+    hybrid.run();
+    double wall = MPI_Wtime() - start;
+
+    Hybrid_Timing timing = hybrid.get_timing();
+    EXPECT_GT(timing.compute, 0.0);
+    EXPECT_GE(timing.communication, 0.0);
+    EXPECT_LE(timing.compute + timing.communication, wall + 1e-6);
+
+    hybrid.report_timing();
+}
+
+// ============================================================================
+// Test main, link against gtest without gtest_main
+// ============================================================================
+
+int main(int argc, char** argv)
+{
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+    ::testing::InitGoogleTest(&argc, argv);
+    int result = RUN_ALL_TESTS();
+    MPI_Finalize();
+    return result;
+}
@@ -2,6 +2,12 @@
 #include "gtest/gtest.h"
 #include <omp.h>
 #include "testing_functions.h"
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 // ============================================================================
 // PICA_MS Constructor Tests
@@ -365,6 +371,30 @@ TEST(PICA_MS_Class, BoundaryConditionsRespected)
     SUCCEED(); // Algorithm should respect the specified bounds
 }
 
+TEST(PICA_MS_Class, BatchObjectiveRunCompletes)
+{
+    PICA_MS pica_ms(60, 8, 25, 2.0, 0.1, 0.1, -5.0, 5.0,
+        sphere_batch_function, false, 4);
+
+    pica_ms.setup_parallel();
+    EXPECT_NO_THROW(pica_ms.run_parallel());
+}
+
+TEST(PICA_MS_Class, EvaluationCacheSharedByThreads)
+{
+    PICA_MS pica_ms(200, 2, 40, 2.0, 0.01, 0.1, -5.0, 5.0,
+        sphere_batch_function, false, 4);
+    pica_ms.enable_evaluation_cache(0.05, 4096);
+
+    pica_ms.setup_parallel();
+    EXPECT_NO_THROW(pica_ms.run_parallel());
+
+    const Evaluation_Cache* cache = pica_ms.get_evaluation_cache();
+    ASSERT_NE(cache, nullptr);
+    EXPECT_GT(cache->hits(), 0);
+    EXPECT_LE(cache->size(), 4096u + 16u);
+}
+
 // ============================================================================
 // PICA_MS OpenMP Specific Tests
 // ============================================================================
@@ -387,4 +417,201 @@ TEST(PICA_MS_Class, ThreadCountRespected)
     pica_ms.setup_parallel();
     EXPECT_NO_THROW(pica_ms.run_parallel());
 
-}
\ No newline at end of file
+}
+
+TEST(PICA_MS_Class, SameSeedAndThreadsReproduceRun)
+{
+    PICA_MS first(120, 4, 30, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, false, 4, 31);
+    PICA_MS second(120, 4, 30, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, false, 4, 31);
+    first.setup_parallel();
+    second.setup_parallel();
+    first.run_parallel();
+    second.run_parallel();
+
+    EXPECT_EQ(first.get_best_fitness(), second.get_best_fitness());
+    EXPECT_EQ(first.get_best_solution(), second.get_best_solution());
+}
+
+TEST(PICA_MS_Class, MutinyKeepsEmpiresConsistent)
+{
+    PICA_MS pica(200, 8, 25, 2.0, 0.3, 0.5, -5.0, 5.0, sphere_function, false, 4, 17);
+    pica.setup_parallel();
+    pica.run_parallel();
+
+    size_t vassal_count = 0;
+    for (Country* emperor : pica.get_empires())
+    {
+        EXPECT_EQ(emperor->index_in_list, -1);
+        double sum = 0;
+        for (size_t i = 0; i < emperor->vassals.size(); ++i)
+        {
+            Country* vassal = emperor->vassals[i];
+            EXPECT_EQ(vassal->index_in_list, static_cast<int>(i));
+            EXPECT_EQ(static_cast<Country*>(vassal->vassal_of_empire), emperor);
+            sum += vassal->fitness;
+        }
+        // Aggregates kept by the threads that re-evaluated the vassals
+        EXPECT_NEAR(emperor->vassal_fitness_sum, sum, 1e-9 * (1 + std::abs(sum)));
+        vassal_count += emperor->vassals.size();
+    }
+    EXPECT_EQ(vassal_count + pica.get_empires().size(), 200u);
+}
+
+TEST(PICA_MS_Class, NumaModeReproducesDefaultRun)
+{
+    PICA_MS plain(160, 4, 20, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, false, 4, 23);
+    PICA_MS numa(160, 4, 20, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, false, 4, 23);
+    numa.enable_numa();
+    plain.setup_parallel();
+    numa.setup_parallel();
+    plain.run_parallel();
+    numa.run_parallel();
+
+    // Chunks draw from their own streams, so placement does not change the result
+    EXPECT_EQ(plain.get_best_fitness(), numa.get_best_fitness());
+    EXPECT_EQ(plain.get_best_solution(), numa.get_best_solution());
+}
+
+TEST(PICA_MS_Class, NumaPlacementReportsOwnedRows)
+{
+    PICA_MS pica(300, 16, 5, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, false, 4, 5);
+    pica.enable_numa();
+    pica.setup_parallel();
+
+    Numa_Placement placement = pica.get_numa_placement();
+    EXPECT_EQ(std::accumulate(placement.rows.begin(), placement.rows.end(), 0LL), 300);
+    if (!placement.pages.empty())
+    {
+        EXPECT_EQ(placement.pages.size(), placement.rows.size());
+        EXPECT_GT(std::accumulate(placement.pages.begin(), placement.pages.end(), 0LL), 0);
+    }
+}
+
+#ifdef __linux__
+TEST(PICA_MS_Class, NumaModeRestoresAffinity)
+{
+    cpu_set_t before;
+    ASSERT_EQ(sched_getaffinity(0, sizeof(before), &before), 0);
+
+    PICA_MS pica(120, 4, 5, 2.0, 0.1, 0.1, -5.0, 5.0, sphere_function, false, 4, 9);
+    pica.enable_numa();
+    pica.setup_parallel();
+    pica.run_parallel();
+
+    // The pool threads come back with the CPUs they started with
+    int unchanged = 0;
+    #pragma omp parallel num_threads(4) reduction(+:unchanged)
+    {
+        cpu_set_t now;
+        if (sched_getaffinity(0, sizeof(now), &now) == 0 && CPU_EQUAL(&now, &before))
+            unchanged = 1;
+    }
+    EXPECT_EQ(unchanged, 4);
+}
+#endif
+
+TEST(Task_Scheduler, EveryVassalScheduledOnce)
+{
+    // One dominant empire, as late in a run
+    std::vector<int> sizes = { 5000, 3, 0, 40 };
+    int workers = 4;
+    Task_Scheduler scheduler;
+    scheduler.distribute(sizes, workers, Task_Scheduler::chunk_size(5043, workers));
+
+    std::vector<std::vector<int>> seen(sizes.size());
+    for (size_t e = 0; e < sizes.size(); ++e)
+        seen[e].assign(sizes[e], 0);
+    std::vector<int> tasks_per_worker(workers, 0);
+
+    #pragma omp parallel num_threads(workers)
+    {
+        int tid = omp_get_thread_num();
+        Vassal_Task task;
+        while (scheduler.next(tid, task))
+        {
+            #pragma omp critical
+            {
+                ++tasks_per_worker[tid];
+                for (int i = task.first; i < task.first + task.count; ++i)
+                    ++seen[task.empire][i];
+            }
+        }
+    }
+
+    for (size_t e = 0; e < sizes.size(); ++e)
+        for (int count : seen[e])
+            EXPECT_EQ(count, 1);
+
+    int total_tasks = 0;
+    for (int t : tasks_per_worker)
+        total_tasks += t;
+    EXPECT_GE(total_tasks, workers);
+}
+
+TEST(Task_Scheduler, IdleWorkerStealsEverything)
+{
+    Task_Scheduler scheduler;
+    scheduler.distribute({ 64 }, 4, 16);
+
+    // Worker 3 drains its own deque, then steals the chunks dealt to the others
+    Vassal_Task task;
+    int taken = 0;
+    while (scheduler.next(3, task))
+        ++taken;
+    EXPECT_EQ(taken, 4);
+}
+
+TEST(Task_Scheduler, StealsFromOwnNodeFirst)
+{
+    Task_Scheduler scheduler;
+    scheduler.set_worker_nodes({ 0, 0, 1, 1 });
+    scheduler.distribute({ 64, 64 }, 4, 16, [](const Vassal_Task& task) { return task.empire; });
+
+    // Empire 0 lives on node 0, so worker 0 finishes it before touching empire 1
+    Vassal_Task task;
+    std::vector<int> order;
+    while (scheduler.next(0, task))
+        order.push_back(task.empire);
+    ASSERT_EQ(order.size(), 8u);
+    EXPECT_TRUE(std::is_sorted(order.begin(), order.end()));
+    EXPECT_EQ(std::count(order.begin(), order.end(), 0), 4);
+}
+
+// Objective that costs a fixed amount of work per row
+static void expensive_batch_function(const double* positions, int count, int dim, int stride, double* fitness)
+{
+    for (int i = 0; i < count; ++i)
+    {
+        const double* x = positions + static_cast<size_t>(i) * stride;
+        double sum = 0;
+        for (int rep = 0; rep < 2000; ++rep)
+            for (int d = 0; d < dim; ++d)
+                sum += x[d] * x[d] * (1.0 + 1e-9 * rep);
+        fitness[i] = sum / 2000;
+    }
+}
+
+static double timed_run(int threads)
+{
+    PICA_MS pica_ms(400, 10, 20, 2.0, 0.1, 0.1, -5.0, 5.0,
+        expensive_batch_function, false, threads, 5);
+    pica_ms.setup_parallel();
+    auto start = std::chrono::steady_clock::now();
+    pica_ms.run_parallel();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+TEST(PICA_MS_Class, RunScalesWithThreads)
+{
+    // Only meaningful with a core per thread, so machines with fewer than
+    // four processors skip it and leave the scaling unchecked
+    if (omp_get_num_procs() < 4)
+        GTEST_SKIP() << "needs at least 4 processors, found " << omp_get_num_procs();
+
+    double one = timed_run(1);
+    double two = timed_run(2);
+    double four = timed_run(4);
+
+    EXPECT_LT(two, one * 0.8);
+    EXPECT_LT(four, two * 0.8);
+}
@@ -32,3 +32,15 @@ double rosenbrock_function(const std::vector<double>& x)
     }
     return sum;
 }
+
+void sphere_batch_function(const double* positions, int count, int dim, int stride, double* fitness)
+{
+    for (int i = 0; i < count; ++i) {
+        const double* x = positions + static_cast<size_t>(i) * stride;
+        double sum = 0.0;
+        for (int d = 0; d < dim; ++d) {
+            sum += x[d] * x[d];
+        }
+        fitness[i] = sum;
+    }
+}
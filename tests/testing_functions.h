@@ -5,4 +5,5 @@
 
 double sphere_function(const std::vector<double>& x);
 double rastrigin_function(const std::vector<double>& x);
-double rosenbrock_function(const std::vector<double>& x);
\ No newline at end of file
+double rosenbrock_function(const std::vector<double>& x);
+void sphere_batch_function(const double* positions, int count, int dim, int stride, double* fitness);